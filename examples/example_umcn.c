@@ -35,6 +35,12 @@ static rt_sem_t event;
 MCN_DEFINE(count, sizeof(count_topic_t));
 MCN_DEFINE(systick, sizeof(systick_topic_t));
 
+#ifdef UMCN_USING_SCHEMA
+/* count topic is echoed through its schema, no echo function is needed */
+MCN_SCHEMA(count_schema,
+    MCN_FIELD_ARRAY(count_topic_t, str, MCN_TYPE_CHAR),
+    MCN_FIELD(count_topic_t, count, sizeof(unsigned long) == 8 ? MCN_TYPE_UINT64 : MCN_TYPE_UINT32));
+#else
 static int count_topic_echo(void* parameter)
 {
     count_topic_t count_topic;
@@ -46,6 +52,7 @@ static int count_topic_echo(void* parameter)
     rt_kprintf("string:%s count:%lu\n", count_topic.str, count_topic.count);
     return 0;
 }
+#endif
 
 static int systick_topic_echo(void* parameter)
 {
@@ -95,7 +102,12 @@ static void test_entry(void* parameter)
 int mcn_test(int argc, char** argv)
 {
     /* advertise topic and provide echo function */
+#ifdef UMCN_USING_SCHEMA
+    mcn_advertise(MCN_HUB(count), RT_NULL);
+    mcn_set_schema(MCN_HUB(count), &count_schema);
+#else
     mcn_advertise(MCN_HUB(count), count_topic_echo);
+#endif
     mcn_advertise(MCN_HUB(systick), systick_topic_echo);
 
     /* subscribe topic in asynchronous mode. 
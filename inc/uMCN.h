@@ -22,31 +22,329 @@ extern "C" {
 #endif
 
 #include <rtthread.h>
+#ifdef UMCN_USING_SCHEMA
+#include <stddef.h>
+#endif
 
 #define MCN_MALLOC(size)            rt_malloc(size)
 #define MCN_FREE(ptr)               rt_free(ptr)
 #define MCN_ENTER_CRITICAL          rt_enter_critical()
 #define MCN_EXIT_CRITICAL           rt_exit_critical()
+#ifdef RT_USING_SMP
+/* topic spinlock protects against other cores. Local interrupts are disabled
+ * while locked, since topics can be published from ISR. level (rt_base_t)
+ * keeps the interrupt status to be restored */
+#ifndef MCN_SPINLOCK_INIT
+#ifdef RT_SPINLOCK_INIT
+#define MCN_SPINLOCK_INIT RT_SPINLOCK_INIT
+#else
+/* unlocked spinlock of ports whose kernel has no RT_SPINLOCK_INIT, define
+ * MCN_SPINLOCK_INIT if the unlocked state of rt_hw_spinlock_t is not zero */
+#define MCN_SPINLOCK_INIT { 0 }
+#endif
+#endif
+/* statically allocated locks use MCN_SPINLOCK_INIT, others rt_spin_lock_init() */
+#define MCN_HUB_LOCK_INITIALIZER    , .lock = MCN_SPINLOCK_INIT
+#define MCN_HUB_LOCK(hub, level)    ((level) = rt_spin_lock_irqsave(&(hub)->lock))
+#define MCN_HUB_UNLOCK(hub, level)  rt_spin_unlock_irqrestore(&(hub)->lock, level)
+#define MCN_CPUS_NR                 RT_CPUS_NR
+#define MCN_CPU_ID()                rt_hw_cpu_id()
+#else
+#define MCN_HUB_LOCK_INITIALIZER
+#define MCN_HUB_LOCK(hub, level)    ((level) = 0, rt_enter_critical())
+#define MCN_HUB_UNLOCK(hub, level)  ((void)(level), rt_exit_critical())
+#define MCN_CPUS_NR                 1
+#define MCN_CPU_ID()                0
+#endif
 #define MCN_EVENT_HANDLE            rt_sem_t
 #define MCN_SEND_EVENT(event)       rt_sem_release(event)
 #define MCN_WAIT_EVENT(event, time) rt_sem_take(event, time)
 #define MCN_ASSERT(EX)              RT_ASSERT(EX)
 
+#ifdef UMCN_USING_CACHE_ALIGN
+#ifndef MCN_CACHE_LINE_SIZE
+#define MCN_CACHE_LINE_SIZE 32
+#endif
+/* Allocate memory occupying whole cache lines, to avoid false sharing */
+#define MCN_MALLOC_ALIGN(size) rt_malloc_align(RT_ALIGN(size, MCN_CACHE_LINE_SIZE), MCN_CACHE_LINE_SIZE)
+#define MCN_FREE_ALIGN(ptr)    rt_free_align(ptr)
+#define MCN_CACHE_ALIGNED      __attribute__((aligned(MCN_CACHE_LINE_SIZE)))
+#define MCN_ALLOC_SIZE(size)   RT_ALIGN(size, MCN_CACHE_LINE_SIZE)
+#else
+#define MCN_MALLOC_ALIGN(size) MCN_MALLOC(size)
+#define MCN_FREE_ALIGN(ptr)    MCN_FREE(ptr)
+#define MCN_CACHE_ALIGNED
+#define MCN_ALLOC_SIZE(size)   (size)
+#endif
+
+#if !defined(UMCN_USING_COMPACT) || defined(UMCN_USING_WATCH)
+/* Hub keeps the timestamp of last publish */
+#define MCN_HUB_TIMESTAMP
+#endif
+
+#ifndef MCN_TIMESTAMP_US
+/* Timestamp source (us) used to stamp published samples, can be overridden in rtconfig.h */
+#define MCN_TIMESTAMP_US() ((rt_uint64_t)rt_tick_get() * 1000000 / RT_TICK_PER_SECOND)
+#endif
+
+#ifdef UMCN_USING_VARSIZE
+#ifndef MCN_SLAB_CLASS_NUM
+/* Buffer size classes of variable size topics, 32, 64, ... (32 << (MCN_SLAB_CLASS_NUM - 1)) bytes */
+#define MCN_SLAB_CLASS_NUM 8
+#endif
+#ifndef MCN_SLAB_CACHE_NUM
+/* Free buffers kept for reuse in each size class */
+#define MCN_SLAB_CACHE_NUM 4
+#endif
+#endif
+
+#ifdef UMCN_USING_PERSIST
+#ifndef MCN_PERSIST_STACK_SIZE
+#define MCN_PERSIST_STACK_SIZE 1024
+#endif
+#ifndef MCN_PERSIST_PRIORITY
+/* Snapshots are written in background at low priority */
+#define MCN_PERSIST_PRIORITY (RT_THREAD_PRIORITY_MAX - 2)
+#endif
+#endif
+
+#ifdef UMCN_USING_RECORDER
+#ifndef MCN_RECORDER_SIZE
+/* Size (bytes) of flight recorder ring, must be power of 2 */
+#define MCN_RECORDER_SIZE 16384
+#endif
+#ifndef MCN_RECORDER_MAX_TOPIC
+#define MCN_RECORDER_MAX_TOPIC 32
+#endif
+#endif
+
 #define MCN_MAX_LINK_NUM        30
+/* Maximal number of topics published by mcn_publish_batch() */
+#define MCN_BATCH_MAX_NUM       8
+/* Maximal number of distinct events coalesced by a batch, others are sent at once */
+#define MCN_BATCH_WAKE_NUM      16
+/* Maximal name length of topic created at runtime */
+#define MCN_NAME_MAX_LEN        63
+/* Initial bucket number of topic registry, doubled as topics are added */
+#define MCN_HASH_INIT_SIZE      16
 #define MCN_FREQ_EST_WINDOW_LEN 5
+/* Publish counts are kept in slots of 2^20 us (about 1s) */
+#define MCN_FREQ_EST_SLOT_SHIFT 20
+
+#ifdef UMCN_USING_HISTORY
+typedef struct mcn_history* McnHistory_t;
+#endif
+
+/* Output function used to export uMCN information */
+typedef void (*McnOutput_t)(void* ctx, const void* buf, rt_uint32_t len);
+
+#ifdef UMCN_USING_GRAPH
+#define MCN_MAX_PUBLISHER_NUM 4
+
+enum {
+    MCN_GRAPH_DOT = 0,
+    MCN_GRAPH_JSON,
+};
+
+typedef struct mcn_publisher McnPublisher;
+struct mcn_publisher {
+    /* publisher thread name */
+    char owner[RT_NAME_MAX];
+    rt_uint32_t published;
+};
+#endif
+
+#ifdef UMCN_USING_TRACE
+#ifndef MCN_TRACE_BUFFER_SIZE
+/* Number of trace events kept for each core */
+#define MCN_TRACE_BUFFER_SIZE 256
+#endif
+
+enum {
+    MCN_TRACE_PUBLISH_BEGIN = 0,
+    MCN_TRACE_PUBLISH_END,
+    MCN_TRACE_COPY,
+    MCN_TRACE_WAKEUP,
+    MCN_TRACE_CALLBACK_BEGIN,
+    MCN_TRACE_CALLBACK_END,
+    MCN_TRACE_SWITCH,
+};
+#endif
+
+#ifdef UMCN_USING_WATCH
+#ifndef MCN_WATCH_RESOLUTION
+/* Watchdog timer wheel resolution in ticks */
+#define MCN_WATCH_RESOLUTION (RT_TICK_PER_SECOND / 100 > 0 ? RT_TICK_PER_SECOND / 100 : 1)
+#endif
+
+typedef struct mcn_watch McnWatch;
+typedef struct mcn_watch* McnWatch_t;
+struct mcn_watch {
+    struct mcn_hub* hub;
+    /* deadline (us) between two publishes */
+    rt_uint32_t period;
+    /* called when topic becomes stale (RT_TRUE) or is published again (RT_FALSE) */
+    void (*timeout)(McnWatch_t watch, rt_bool_t stale);
+    void* parameter;
+    /* number of deadlines missed */
+    rt_uint32_t missed;
+    volatile rt_uint8_t stale;
+    /* below are maintained by the timer wheel */
+    rt_uint8_t active;
+    rt_uint32_t expire;
+    rt_uint64_t last;
+    McnWatch_t next;
+    McnWatch_t* pprev;
+};
+#endif
+
+#ifdef UMCN_USING_GROUP
+#define MCN_GROUP_MAX_MEMBER 8
+
+typedef struct mcn_group McnGroup;
+typedef struct mcn_group* McnGroup_t;
+struct mcn_group {
+    struct mcn_hub* hub[MCN_GROUP_MAX_MEMBER];
+    struct mcn_node* node[MCN_GROUP_MAX_MEMBER];
+    /* member indexes sorted by hub address, hubs are locked in this order */
+    rt_uint8_t order[MCN_GROUP_MAX_MEMBER];
+    rt_uint8_t member_num;
+    /* all members are updated (within tolerance) since last copy */
+    volatile rt_uint8_t ready;
+    /* group callback to be invoked */
+    rt_uint8_t pending;
+    /* bitmask of members updated since last copy */
+    rt_uint32_t updated;
+    /* publish timestamp (us) of each member */
+    rt_uint64_t stamp[MCN_GROUP_MAX_MEMBER];
+    /* maximal timestamp difference (us) of members, 0 to disable */
+    rt_uint32_t tolerance;
+    MCN_EVENT_HANDLE event;
+    void (*cb)(McnGroup_t group, void* parameter);
+    void* parameter;
+#ifdef RT_USING_SMP
+    struct rt_spinlock lock;
+#endif
+};
+#endif
+
+#ifdef UMCN_USING_PARTIAL
+/* Topic data is split into chunks for dirty range tracking */
+#define MCN_DIRTY_CHUNK_NUM       32
+#define MCN_DIRTY_CHUNK_SIZE(hub) (((hub)->obj_size + MCN_DIRTY_CHUNK_NUM - 1) / MCN_DIRTY_CHUNK_NUM)
+#endif
+
+#ifdef UMCN_USING_SCHEMA
+/* Field types of topic schema */
+typedef enum {
+    MCN_TYPE_INT8 = 0,
+    MCN_TYPE_UINT8,
+    MCN_TYPE_INT16,
+    MCN_TYPE_UINT16,
+    MCN_TYPE_INT32,
+    MCN_TYPE_UINT32,
+    MCN_TYPE_INT64,
+    MCN_TYPE_UINT64,
+    MCN_TYPE_FLOAT,
+    MCN_TYPE_DOUBLE,
+    MCN_TYPE_BOOL,
+    /* character array, printed as string */
+    MCN_TYPE_CHAR,
+} McnType;
+
+typedef struct mcn_field McnField;
+struct mcn_field {
+    const char* name;
+    rt_uint8_t type;
+    /* element number, larger than 1 for array */
+    rt_uint16_t count;
+    rt_uint32_t offset;
+};
+
+typedef struct mcn_schema McnSchema;
+struct mcn_schema {
+    const McnField* fields;
+    rt_uint16_t field_num;
+};
+
+/* Describe a field of topic structure */
+#define MCN_FIELD(_struct, _member, _type) \
+    { #_member, _type, 1, offsetof(_struct, _member) }
+/* Describe an array field of topic structure */
+#define MCN_FIELD_ARRAY(_struct, _member, _type)                                         \
+    { #_member, _type, sizeof(((_struct*)0)->_member) / sizeof(((_struct*)0)->_member[0]), \
+        offsetof(_struct, _member) }
+/* Define a topic schema from field list */
+#define MCN_SCHEMA(_name, ...)                                        \
+    static const McnField __mcn_fields_##_name[] = { __VA_ARGS__ };   \
+    static const McnSchema _name = {                                  \
+        .fields = __mcn_fields_##_name,                               \
+        .field_num = sizeof(__mcn_fields_##_name) / sizeof(McnField), \
+    }
+#endif
 
 typedef struct mcn_node McnNode;
 typedef struct mcn_node* McnNode_t;
 struct mcn_node {
+#ifdef UMCN_USING_COMPACT
+    /* event handle, with renewal flag packed into its lowest bit */
+    volatile rt_ubase_t event;
+#else
     volatile rt_uint8_t renewal;
+#endif
+#ifdef UMCN_USING_PARTIAL
+    /* bitmask of chunks updated since last copy */
+    volatile rt_uint32_t dirty;
+#endif
+#ifndef UMCN_USING_COMPACT
     MCN_EVENT_HANDLE event;
+#endif
     void (*pub_cb)(void* parameter);
     McnNode_t next;
+#ifdef UMCN_USING_GROUP
+    /* group this node belongs to, set by mcn_group_add() */
+    McnGroup_t group;
+    rt_uint8_t group_index;
+#endif
+#ifdef UMCN_USING_GRAPH
+    /* subscriber thread or module name */
+    char owner[RT_NAME_MAX];
+    /* samples delivered to this node */
+    rt_uint32_t delivered;
+    /* samples overwritten before being read */
+    rt_uint32_t dropped;
+    /* total time (us) spent in publish callback */
+    rt_uint64_t cb_time;
+#endif
 };
 
+#ifdef UMCN_USING_COMPACT
+/* Event handle is at least 4 bytes aligned, its lowest bit is free for renewal flag */
+#define MCN_NODE_EVENT(node)         ((MCN_EVENT_HANDLE)((node)->event & ~(rt_ubase_t)1))
+#define MCN_NODE_RENEWAL(node)       ((node)->event & 1)
+#define MCN_NODE_SET_RENEWAL(node)   ((node)->event |= 1)
+#define MCN_NODE_CLEAR_RENEWAL(node) ((node)->event &= ~(rt_ubase_t)1)
+#else
+#define MCN_NODE_EVENT(node)         ((node)->event)
+#define MCN_NODE_RENEWAL(node)       ((node)->renewal)
+#define MCN_NODE_SET_RENEWAL(node)   ((node)->renewal = 1)
+#define MCN_NODE_CLEAR_RENEWAL(node) ((node)->renewal = 0)
+#endif
+
 typedef struct mcn_hub McnHub;
 typedef struct mcn_hub* McnHub_t;
+typedef struct mcn_list McnList;
+typedef struct mcn_list* McnList_t;
+struct mcn_list {
+    McnHub_t hub;
+    McnList_t next;
+    McnList_t prev;
+    /* next entry in the same registry hash bucket */
+    McnList_t hash_next;
+};
+
 struct mcn_hub {
+    /* read-mostly part, accessed by both publishers and subscribers */
     const char* obj_name;
     const rt_uint32_t obj_size;
     void* pdata;
@@ -55,19 +353,120 @@ struct mcn_hub {
     rt_uint32_t link_num;
     rt_uint8_t published;
     rt_uint8_t suspend;
+#ifdef UMCN_USING_VARSIZE
+    /* obj_size is the maximal size, pdata points into a refcounted slab buffer
+     * holding the last published length */
+    rt_uint8_t varsize;
+#endif
+#ifdef UMCN_USING_PERSIST
+    /* last value is saved in snapshot */
+    rt_uint8_t persist;
+#endif
+#ifdef UMCN_USING_RECORDER
+    /* index of topic in flight recorder plus 1, 0 if not recorded */
+    rt_uint8_t rec_id;
+#endif
+#ifndef UMCN_USING_COMPACT
     int (*echo)(void* parameter);
-    /* publish freq estimate */
-    float freq;
-    rt_uint16_t freq_est_window[MCN_FREQ_EST_WINDOW_LEN];
-    rt_uint16_t window_index;
+#endif
+    /* registry entry, linked when advertised */
+    McnList entry;
+    /* reference count of topic created by mcn_create(), 0 for static topic */
+    rt_uint32_t ref;
+    rt_uint8_t destroyed;
+#ifdef UMCN_USING_HISTORY
+    /* timestamped sample history */
+    McnHistory_t history;
+#endif
+#ifdef UMCN_USING_SCHEMA
+    /* topic layout description */
+    const McnSchema* schema;
+#endif
+#ifndef UMCN_USING_COMPACT
+    /* timestamp (us) of last publish, written on each publish. With UMCN_USING_CACHE_ALIGN
+     * it starts a new cache line so readers don't lose the read-mostly part */
+    rt_uint64_t timestamp MCN_CACHE_ALIGNED;
+    /* publish count of each slot, plus the slot being counted, see mcn_get_freq() */
+    rt_uint16_t freq_est_window[MCN_FREQ_EST_WINDOW_LEN + 1];
+    /* slot number of last publish */
+    rt_uint32_t window_slot;
+#elif defined(MCN_HUB_TIMESTAMP)
+    /* timestamp (us) of last publish */
+    rt_uint64_t timestamp;
+#endif
+#ifdef RT_USING_SMP
+    /* protect topic data and links. It's taken on each publish and copy, so
+     * it stays with the written fields */
+    struct rt_spinlock lock;
+#endif
+#ifdef UMCN_USING_PERSIST
+    /* published since last snapshot */
+    rt_uint8_t persist_dirty;
+    /* data is restored from snapshot and not published since boot */
+    rt_uint8_t stale;
+#endif
+#ifdef UMCN_USING_GRAPH
+    McnPublisher publisher[MCN_MAX_PUBLISHER_NUM];
+    /* node whose publish callback is running */
+    McnNode_t cb_node;
+#endif
 };
 
-typedef struct mcn_list McnList;
-typedef struct mcn_list* McnList_t;
-struct mcn_list {
+/* Topic and its data published by mcn_publish_batch() */
+typedef struct mcn_batch_item McnBatchItem;
+struct mcn_batch_item {
     McnHub_t hub;
-    McnList_t next;
+    const void* data;
+};
+
+/* Memory used by uMCN in bytes, as requested from allocator or statically defined */
+typedef struct mcn_mem_usage McnMemUsage;
+struct mcn_mem_usage {
+    rt_uint32_t topic_num;
+    rt_uint32_t node_num;
+    /* hub structures excluding list entries, including runtime topic names */
+    rt_uint32_t hub;
+    /* list entries, embedded in hubs */
+    rt_uint32_t list;
+    rt_uint32_t payload;
+    rt_uint32_t node;
+    /* registry hash table */
+    rt_uint32_t registry;
+    rt_uint32_t history;
+    /* slab buffers of variable size topics, including cached free ones */
+    rt_uint32_t slab;
+    rt_uint32_t total;
+};
+
+#ifdef UMCN_USING_PERSIST
+/* Storage backend of topic snapshot, e.g, a file or a flash partition */
+typedef struct mcn_persist_ops McnPersistOps;
+struct mcn_persist_ops {
+    /* read stored snapshot at offset, return number of bytes read or negative error */
+    rt_int32_t (*read)(void* ctx, rt_uint32_t offset, void* buf, rt_uint32_t len);
+    /* replace stored snapshot with a new one, return RT_EOK on success */
+    rt_err_t (*write)(void* ctx, const void* buf, rt_uint32_t len);
 };
+#endif
+
+#ifdef UMCN_USING_PATTERN
+typedef struct mcn_pattern McnPattern;
+typedef struct mcn_pattern* McnPattern_t;
+struct mcn_pattern {
+    /* name pattern, '*' matches any characters and '?' matches one character */
+    const char* expr;
+    MCN_EVENT_HANDLE event;
+    void (*pub_cb)(void* parameter);
+    /* called when a matching topic is subscribed, or destroyed with RT_NULL node */
+    void (*bind)(McnPattern_t pattern, McnHub_t hub, McnNode_t node);
+    void* parameter;
+    /* subscribed topics */
+    struct mcn_binding* binding;
+    rt_uint32_t bind_num;
+    /* next pattern with the same literal prefix */
+    McnPattern_t next;
+};
+#endif
 
 /* Obtain uMCN hub according to name */
 #define MCN_HUB(_name) (&__mcn_##_name)
@@ -83,15 +482,32 @@ struct mcn_list {
         .link_tail = RT_NULL,       \
         .link_num = 0,           \
         .published = 0,          \
-        .suspend = 0,            \
-        .freq = 0.0f             \
+        .suspend = 0             \
+        MCN_HUB_LOCK_INITIALIZER \
+    }
+#ifdef UMCN_USING_VARSIZE
+/* Define a variable size uMCN topic, each publish carries at most _max_size bytes */
+#define MCN_DEFINE_VAR(_name, _max_size) \
+    McnHub __mcn_##_name = {             \
+        .obj_name = #_name,              \
+        .obj_size = _max_size,           \
+        .pdata = RT_NULL,                \
+        .link_head = RT_NULL,            \
+        .link_tail = RT_NULL,            \
+        .link_num = 0,                   \
+        .published = 0,                  \
+        .suspend = 0,                    \
+        .varsize = 1                     \
+        MCN_HUB_LOCK_INITIALIZER         \
     }
+#endif
 
 int mcn_init(void);
 rt_err_t mcn_advertise(McnHub_t hub, int (*echo)(void* parameter));
 McnNode_t mcn_subscribe(McnHub_t hub, MCN_EVENT_HANDLE event, void (*pub_cb)(void* parameter));
 rt_err_t mcn_unsubscribe(McnHub_t hub, McnNode_t node);
 rt_err_t mcn_publish(McnHub_t hub, const void* data);
+rt_err_t mcn_publish_batch(const McnBatchItem* items, rt_uint32_t num);
 rt_bool_t mcn_poll(McnNode_t node_t);
 rt_bool_t mcn_poll_sync(McnNode_t node_t, rt_int32_t timeout);
 rt_err_t mcn_copy(McnHub_t hub, McnNode_t node_t, void* buffer);
@@ -100,7 +516,90 @@ void mcn_suspend(McnHub_t hub);
 void mcn_resume(McnHub_t hub);
 McnList_t mcn_get_list(void);
 McnHub_t mcn_iterate(McnList_t* ite);
+void mcn_iterate_end(McnList_t* ite);
 void mcn_node_clear(McnNode_t node_t);
+McnHub_t mcn_create(const char* name, rt_uint32_t size, int (*echo)(void* parameter));
+rt_err_t mcn_destroy(McnHub_t hub);
+McnHub_t mcn_find(const char* name);
+void mcn_release(McnHub_t hub);
+void mcn_mem_usage(McnMemUsage* usage);
+float mcn_get_freq(McnHub_t hub);
+#ifdef UMCN_USING_WATCH
+rt_err_t mcn_watch_start(McnWatch_t watch, McnHub_t hub, rt_uint32_t period_ms,
+    void (*timeout)(McnWatch_t watch, rt_bool_t stale), void* parameter);
+void mcn_watch_stop(McnWatch_t watch);
+rt_bool_t mcn_watch_is_stale(McnWatch_t watch);
+#endif
+#ifdef UMCN_USING_VARSIZE
+McnHub_t mcn_create_var(const char* name, rt_uint32_t max_size, int (*echo)(void* parameter));
+rt_err_t mcn_publish_var(McnHub_t hub, const void* data, rt_uint32_t len);
+rt_int32_t mcn_copy_var(McnHub_t hub, McnNode_t node_t, void* buffer, rt_uint32_t size);
+const void* mcn_borrow(McnHub_t hub, McnNode_t node_t, rt_uint32_t* len);
+void mcn_return(const void* data);
+#endif
+#ifdef UMCN_USING_PERSIST
+rt_err_t mcn_persist_init(const McnPersistOps* ops, void* ctx, rt_uint32_t period_ms);
+rt_err_t mcn_persist_enable(McnHub_t hub);
+rt_err_t mcn_persist_save(void);
+rt_bool_t mcn_is_stale(McnHub_t hub);
+#ifdef RT_USING_DFS
+/* File backend, ctx is the file path */
+extern const McnPersistOps mcn_persist_file_ops;
+#endif
+#endif
+#ifdef UMCN_USING_RECORDER
+rt_err_t mcn_recorder_add(McnHub_t hub, rt_bool_t (*trigger)(const void* data, rt_uint32_t len));
+void mcn_recorder_trigger(void);
+rt_bool_t mcn_recorder_triggered(void);
+void mcn_recorder_resume(void);
+rt_err_t mcn_recorder_dump(McnOutput_t output, void* ctx);
+#endif
+#ifdef UMCN_USING_PATTERN
+rt_err_t mcn_pattern_subscribe(McnPattern_t pattern, const char* expr, MCN_EVENT_HANDLE event,
+    void (*pub_cb)(void* parameter), void (*bind)(McnPattern_t pattern, McnHub_t hub, McnNode_t node),
+    void* parameter);
+void mcn_pattern_unsubscribe(McnPattern_t pattern);
+McnNode_t mcn_pattern_node(McnPattern_t pattern, McnHub_t hub);
+#endif
+#ifdef UMCN_USING_HISTORY
+rt_err_t mcn_history_enable(McnHub_t hub, rt_uint16_t depth,
+    void (*interp)(const void* prev, const void* next, float ratio, void* out));
+rt_err_t mcn_copy_at(McnHub_t hub, rt_uint64_t timestamp, void* buffer);
+#endif
+#ifdef UMCN_USING_SCHEMA
+rt_err_t mcn_set_schema(McnHub_t hub, const McnSchema* schema);
+rt_uint32_t mcn_serialized_size(McnHub_t hub);
+rt_int32_t mcn_serialize(McnHub_t hub, const void* data, void* buffer, rt_uint32_t size);
+rt_int32_t mcn_deserialize(McnHub_t hub, const void* buffer, rt_uint32_t len, void* data);
+rt_int32_t mcn_format(McnHub_t hub, const void* data, char* buffer, rt_uint32_t size);
+#endif
+#ifdef UMCN_USING_GRAPH
+void mcn_node_set_owner(McnNode_t node_t, const char* owner);
+rt_err_t mcn_graph_export(int format, McnOutput_t output, void* ctx);
+#endif
+#ifdef UMCN_USING_TRACE
+void mcn_trace_start(void);
+void mcn_trace_stop(void);
+rt_err_t mcn_trace_dump(McnOutput_t output, void* ctx);
+/* Record a trace event, used by the inline copies of uMCN.hpp */
+extern volatile rt_bool_t mcn_trace_enabled;
+void mcn_trace_record(rt_uint8_t type, McnHub_t hub);
+#endif
+#ifdef UMCN_USING_GROUP
+rt_err_t mcn_group_init(McnGroup_t group, MCN_EVENT_HANDLE event, rt_uint32_t tolerance_us,
+    void (*cb)(McnGroup_t group, void* parameter), void* parameter);
+rt_err_t mcn_group_add(McnGroup_t group, McnHub_t hub);
+rt_bool_t mcn_group_poll(McnGroup_t group);
+rt_bool_t mcn_group_poll_sync(McnGroup_t group, rt_int32_t timeout);
+rt_err_t mcn_group_copy(McnGroup_t group, void* const buffer[], rt_uint32_t len[]);
+void mcn_group_detach(McnGroup_t group);
+#endif
+#ifdef UMCN_USING_PARTIAL
+rt_err_t mcn_publish_partial(McnHub_t hub, rt_uint32_t offset, rt_uint32_t len, const void* data);
+rt_err_t mcn_copy_partial(McnHub_t hub, McnNode_t node_t, rt_uint32_t offset, rt_uint32_t len, void* buffer);
+rt_bool_t mcn_is_dirty(McnHub_t hub, McnNode_t node_t, rt_uint32_t offset, rt_uint32_t len);
+rt_bool_t mcn_dirty_range(McnHub_t hub, McnNode_t node_t, rt_uint32_t* offset, rt_uint32_t* len);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,253 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#ifndef UMCN_HPP__
+#define UMCN_HPP__
+
+#include <string.h>
+#include <type_traits>
+#include <uMCN.h>
+
+/* Fixed size topics up to this size are copied by inline loads and stores */
+#ifndef MCN_INLINE_COPY_MAX
+#define MCN_INLINE_COPY_MAX 64
+#endif
+
+/* Define a typed uMCN topic, which can be accessed by _name##_topic */
+#define MCN_DEFINE_TOPIC(_name, _type) \
+    MCN_DEFINE(_name, sizeof(_type));  \
+    constexpr mcn::Topic<_type> _name##_topic(&__mcn_##_name)
+/* Declare a typed uMCN topic, the topic can be defined in either C or C++.
+ * Its size can't be checked at compile time, so it's asserted on each access */
+#define MCN_DECLARE_TOPIC(_name, _type) \
+    MCN_DECLARE(_name);                 \
+    constexpr mcn::Topic<_type> _name##_topic(&__mcn_##_name)
+
+namespace mcn {
+
+namespace detail {
+
+    /* Whether a topic can be read by copy_inline() */
+    template <typename T>
+    inline bool inline_copyable(McnHub_t hub)
+    {
+#ifdef UMCN_USING_VARSIZE
+        if (hub->varsize) {
+            return false;
+        }
+#endif
+        return sizeof(T) <= MCN_INLINE_COPY_MAX;
+    }
+
+    /* size is known at compile time, so the compiler emits inline loads and stores */
+    template <typename T>
+    inline rt_err_t copy_inline(McnHub_t hub, McnNode_t node, T* data)
+    {
+        rt_base_t level;
+
+        if (hub->pdata == RT_NULL || !hub->published) {
+            return -RT_ERROR;
+        }
+
+        MCN_HUB_LOCK(hub, level);
+        memcpy(data, hub->pdata, sizeof(T));
+        if (node != RT_NULL) {
+            MCN_NODE_CLEAR_RENEWAL(node);
+#ifdef UMCN_USING_PARTIAL
+            node->dirty = 0;
+#endif
+        }
+        MCN_HUB_UNLOCK(hub, level);
+
+#ifdef UMCN_USING_TRACE
+        if (mcn_trace_enabled) {
+            mcn_trace_record(MCN_TRACE_COPY, hub);
+        }
+#endif
+
+        return RT_EOK;
+    }
+
+} // namespace detail
+
+template <typename T>
+class Subscriber;
+
+/**
+ * @brief Typed handle of a uMCN topic
+ *
+ * @tparam T Topic data type, must be trivially copyable
+ */
+template <typename T>
+class Topic {
+    static_assert(std::is_trivially_copyable<T>::value, "uMCN topic type must be trivially copyable");
+    static_assert(sizeof(T) > 0, "uMCN topic type must not be empty");
+
+public:
+    constexpr explicit Topic(McnHub* hub)
+        : hub_(hub)
+    {
+    }
+
+    McnHub_t hub() const
+    {
+        return checked_hub();
+    }
+
+    rt_err_t advertise(int (*echo)(void* parameter) = RT_NULL) const
+    {
+        return mcn_advertise(checked_hub(), echo);
+    }
+
+    rt_err_t publish(const T& data) const
+    {
+        return mcn_publish(checked_hub(), &data);
+    }
+
+    /* Read topic data no matter it has been updated or not */
+    rt_err_t read(T& data) const
+    {
+        McnHub_t hub = checked_hub();
+
+        if (!detail::inline_copyable<T>(hub)) {
+            return mcn_copy_from_hub(hub, &data);
+        }
+
+        return detail::copy_inline(hub, RT_NULL, &data);
+    }
+
+    Subscriber<T> subscribe(MCN_EVENT_HANDLE event = RT_NULL, void (*pub_cb)(void* parameter) = RT_NULL) const
+    {
+        return Subscriber<T>(checked_hub(), mcn_subscribe(checked_hub(), event, pub_cb));
+    }
+
+private:
+    /* topic declared by MCN_DECLARE_TOPIC() may be defined with another size */
+    McnHub_t checked_hub() const
+    {
+        MCN_ASSERT(hub_->obj_size == sizeof(T));
+        return hub_;
+    }
+
+    McnHub* hub_;
+};
+
+/**
+ * @brief Typed subscription of a uMCN topic, unsubscribed on destruction
+ *
+ * @tparam T Topic data type
+ */
+template <typename T>
+class Subscriber {
+public:
+    Subscriber()
+        : hub_(RT_NULL)
+        , node_(RT_NULL)
+    {
+    }
+
+    Subscriber(McnHub_t hub, McnNode_t node)
+        : hub_(hub)
+        , node_(node)
+    {
+    }
+
+    Subscriber(const Subscriber&) = delete;
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    Subscriber(Subscriber&& other)
+        : hub_(other.hub_)
+        , node_(other.node_)
+    {
+        other.node_ = RT_NULL;
+    }
+
+    Subscriber& operator=(Subscriber&& other)
+    {
+        if (this != &other) {
+            unsubscribe();
+            hub_ = other.hub_;
+            node_ = other.node_;
+            other.node_ = RT_NULL;
+        }
+        return *this;
+    }
+
+    ~Subscriber()
+    {
+        unsubscribe();
+    }
+
+    bool valid() const
+    {
+        return node_ != RT_NULL;
+    }
+
+    McnNode_t node() const
+    {
+        return node_;
+    }
+
+    /* Return immediately, true if topic updated */
+    bool poll() const
+    {
+        return mcn_poll(node_) == RT_TRUE;
+    }
+
+    /* Wait until topic updated, event must be provided when subscribe */
+    bool wait(rt_int32_t timeout) const
+    {
+        return mcn_poll_sync(node_, timeout) == RT_TRUE;
+    }
+
+    /* Copy topic data and clear the renewal flag */
+    rt_err_t copy(T& data) const
+    {
+        MCN_ASSERT(node_ != RT_NULL);
+
+        if (!detail::inline_copyable<T>(hub_)) {
+            return mcn_copy(hub_, node_, &data);
+        }
+
+        return detail::copy_inline(hub_, node_, &data);
+    }
+
+    void clear() const
+    {
+        mcn_node_clear(node_);
+    }
+
+    rt_err_t unsubscribe()
+    {
+        rt_err_t err = RT_EOK;
+
+        if (node_ != RT_NULL) {
+            err = mcn_unsubscribe(hub_, node_);
+            node_ = RT_NULL;
+        }
+
+        return err;
+    }
+
+private:
+    McnHub_t hub_;
+    McnNode_t node_;
+};
+
+} // namespace mcn
+
+#endif
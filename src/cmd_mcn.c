@@ -1,13 +1,19 @@
 
 #include <rtthread.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <optparse.h>
 #include <shell.h>
 
 #include "uMCN.h"
+#include "mcn_internal.h"
+
+#define ECHO_TEXT_SIZE                  512
+#define KEY_CHECK_PERIOD                100
+/* topic monitors (hz/bw/delay) running at the same time */
+#define MONITOR_MAX_NUM                 4
 
 #define STRING_COMPARE(str1, str2)      (strcmp(str1, str2) == 0)
 #define PRINT_USAGE(cmd, usage)         rt_kprintf("usage: %s %s\n", #cmd, #usage)
@@ -16,6 +22,12 @@
 #define COMMAND_USAGE(cmd, usage)       rt_kprintf("usage: %s %s\n", cmd, usage)
 #define SHELL_COMMAND(cmd, desc)        rt_kprintf(" %-10s  %s\n", cmd, desc)
 #define SHELL_OPTION(opt, desc)         rt_kprintf(" %-15s  %s\n", opt, desc)
+#ifdef UMCN_USING_COMPACT
+/* custom echo function is removed in compact profile */
+#define HUB_ECHO(hub)                   ((int (*)(void*))RT_NULL)
+#else
+#define HUB_ECHO(hub)                   ((hub)->echo)
+#endif
 
 enum {
     SYSCMD_ALIGN_LEFT,
@@ -23,9 +35,34 @@ enum {
     SYSCMD_ALIGN_RIGHT
 };
 
+enum {
+    MONITOR_HZ,
+    MONITOR_BW,
+    MONITOR_DELAY
+};
+
+/* statistics of topic monitor, updated in publish callback */
+struct monitor_stat {
+    rt_uint64_t last;
+    rt_uint32_t count;
+    /* bytes of published data */
+    rt_uint64_t bytes;
+    rt_uint32_t interval_num;
+    rt_uint32_t interval_min;
+    rt_uint32_t interval_max;
+    /* running mean and sum of squared differences (us), see monitor_update() */
+    double interval_mean;
+    double interval_m2;
+};
+
 extern struct finsh_shell* shell;
 
 static rt_device_t console_dev;
+/* statistics of each running monitor, the slot is taken by a monitor command */
+static struct monitor_stat monitor[MONITOR_MAX_NUM];
+static rt_bool_t monitor_used[MONITOR_MAX_NUM];
+/* topic of each running monitor */
+static McnHub_t monitor_hub[MONITOR_MAX_NUM];
 
 static void show_usage(void)
 {
@@ -34,8 +71,21 @@ static void show_usage(void)
     PRINT_STRING("\ncommand:\n");
     SHELL_COMMAND("list", "List all uMCN topics.");
     SHELL_COMMAND("echo", "Echo a uMCN topic.");
+    SHELL_COMMAND("hz", "Show publish rate of a uMCN topic.");
+    SHELL_COMMAND("bw", "Show bandwidth of a uMCN topic.");
+    SHELL_COMMAND("delay", "Show age of the last sample of a uMCN topic.");
     SHELL_COMMAND("suspend", "Suspend a uMCN topic.");
     SHELL_COMMAND("resume", "Resume a uMCN topic.");
+    SHELL_COMMAND("mem", "Show memory used by uMCN.");
+#ifdef UMCN_USING_GRAPH
+    SHELL_COMMAND("graph", "Show uMCN topic graph.");
+#endif
+#ifdef UMCN_USING_TRACE
+    SHELL_COMMAND("trace", "Record and dump uMCN trace events.");
+#endif
+#ifdef UMCN_USING_RECORDER
+    SHELL_COMMAND("dump", "Dump uMCN flight recorder as binary log.");
+#endif
 }
 
 static void show_echo_usage(void)
@@ -44,8 +94,45 @@ static void show_echo_usage(void)
 
     PRINT_STRING("\noptions:\n");
     SHELL_OPTION("-n, --number", "Set topic echo number, e.g, -n 10 will echo 10 times.");
-    SHELL_OPTION("-p, --period", "Set topic echo period (ms), -p 0 inherits topic period");
+    SHELL_OPTION("-p, --period", "Set minimal topic echo period (ms), -p 0 echoes every sample");
+    SHELL_OPTION("-d, --decimate", "Echo one of every N samples, e.g, -d 10");
+}
+
+static void show_monitor_usage(const char* cmd)
+{
+    COMMAND_USAGE(cmd, "<topic> [options]");
+
+    PRINT_STRING("\noptions:\n");
+    SHELL_OPTION("-n, --number", "Set report number, e.g, -n 10 will report 10 times.");
+    SHELL_OPTION("-w, --window", "Set statistic window (ms), default is 1000ms");
+}
+
+#ifdef UMCN_USING_GRAPH
+static void show_graph_usage(void)
+{
+    COMMAND_USAGE("mcn graph", "[options]");
+
+    PRINT_STRING("\noptions:\n");
+    SHELL_OPTION("-f, --format", "Set output format, dot (default) or json");
 }
+#endif
+
+#ifdef UMCN_USING_TRACE
+static void show_trace_usage(void)
+{
+    COMMAND_USAGE("mcn trace", "<start|stop|dump>");
+}
+#endif
+
+#ifdef UMCN_USING_RECORDER
+static void show_dump_usage(void)
+{
+    COMMAND_USAGE("mcn dump", "[options]");
+
+    PRINT_STRING("\noptions:\n");
+    SHELL_OPTION("-r, --resume", "Resume recording after dump");
+}
+#endif
 
 static void show_suspend_usage(void)
 {
@@ -76,9 +163,17 @@ void list_printf(const char pad, rt_uint32_t len, rt_uint8_t align, const char*
     int length;
 
     va_start(args, fmt);
-    length = vsprintf(buffer, fmt, args);
+    length = vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
+    if (length < 0) {
+        return;
+    }
+    if (length >= (int)sizeof(buffer)) {
+        /* output is truncated */
+        length = sizeof(buffer) - 1;
+    }
+
     if (len <= length) {
         rt_device_write(console_dev, 0, buffer, length);
         return;
@@ -98,6 +193,20 @@ void list_printf(const char pad, rt_uint32_t len, rt_uint8_t align, const char*
     }
 }
 
+static rt_bool_t key_pressed(void)
+{
+#if !defined(RT_USING_POSIX_STDIO) && defined(RT_USING_DEVICE)
+    /* type any key to exit */
+    if (rt_sem_trytake(&shell->rx_sem) == RT_EOK) {
+        int ch;
+        while (rt_device_read(shell->device, -1, &ch, 1) == 1)
+            ;
+        return RT_TRUE;
+    }
+#endif
+    return RT_FALSE;
+}
+
 static int name_maxlen(const char* title)
 {
     int max_len = strlen(title);
@@ -118,6 +227,36 @@ static int name_maxlen(const char* title)
     return max_len;
 }
 
+static rt_bool_t has_echo(McnHub_t hub)
+{
+#ifdef UMCN_USING_SCHEMA
+    if (hub->schema != RT_NULL) {
+        return RT_TRUE;
+    }
+#endif
+    return HUB_ECHO(hub) != RT_NULL ? RT_TRUE : RT_FALSE;
+}
+
+#ifdef UMCN_USING_SCHEMA
+static int schema_echo(McnHub_t hub, void* data, char* text)
+{
+    rt_int32_t len;
+
+    if (mcn_copy_from_hub(hub, data) != RT_EOK) {
+        return -1;
+    }
+
+    len = mcn_format(hub, data, text, ECHO_TEXT_SIZE);
+    if (len < 0) {
+        rt_kprintf("topic text exceeds %d bytes\n", ECHO_TEXT_SIZE);
+        return -1;
+    }
+    rt_device_write(console_dev, 0, text, len);
+
+    return 0;
+}
+#endif
+
 static void list_topic(void)
 {
     rt_uint32_t max_len = name_maxlen("Topic") + 2;
@@ -128,14 +267,147 @@ static void list_topic(void)
 
     McnList_t ite = mcn_get_list();
     for (McnHub_t hub = mcn_iterate(&ite); hub != RT_NULL; hub = mcn_iterate(&ite)) {
-        list_printf(' ', max_len, SYSCMD_ALIGN_LEFT, hub->obj_name); rt_kprintf(" ");
+        list_printf(' ', max_len, SYSCMD_ALIGN_LEFT, "%s", hub->obj_name); rt_kprintf(" ");
         list_printf(' ', strlen("#SUB") + 2, SYSCMD_ALIGN_MIDDLE, "%d", (int)hub->link_num); rt_kprintf(" ");
-        list_printf(' ', strlen("Freq(Hz)") + 2, SYSCMD_ALIGN_MIDDLE, "%.1f", hub->freq); rt_kprintf(" ");
-        list_printf(' ', strlen("Echo") + 2, SYSCMD_ALIGN_MIDDLE, "%s", hub->echo ? "true" : "false"); rt_kprintf(" ");
+#ifdef UMCN_USING_COMPACT
+        /* no freq estimator in compact profile */
+        list_printf(' ', strlen("Freq(Hz)") + 2, SYSCMD_ALIGN_MIDDLE, "-"); rt_kprintf(" ");
+#else
+        list_printf(' ', strlen("Freq(Hz)") + 2, SYSCMD_ALIGN_MIDDLE, "%.1f", mcn_get_freq(hub)); rt_kprintf(" ");
+#endif
+        list_printf(' ', strlen("Echo") + 2, SYSCMD_ALIGN_MIDDLE, "%s", has_echo(hub) ? "true" : "false"); rt_kprintf(" ");
         list_printf(' ', strlen("Suspend") + 2, SYSCMD_ALIGN_MIDDLE, "%s", hub->suspend ? "true" : "false"); rt_kprintf("\n");
     }
 }
 
+static void mem_topic(void)
+{
+    McnMemUsage usage;
+
+    mcn_mem_usage(&usage);
+
+    rt_kprintf("topics:   %u\n", (unsigned)usage.topic_num);
+    rt_kprintf("nodes:    %u\n", (unsigned)usage.node_num);
+    rt_kprintf("hub:      %u bytes (%u each)\n", (unsigned)usage.hub, (unsigned)(sizeof(McnHub) - sizeof(McnList)));
+    rt_kprintf("list:     %u bytes (%u each)\n", (unsigned)usage.list, (unsigned)sizeof(McnList));
+    rt_kprintf("payload:  %u bytes\n", (unsigned)usage.payload);
+    rt_kprintf("node:     %u bytes (%u each)\n", (unsigned)usage.node, (unsigned)MCN_ALLOC_SIZE(sizeof(McnNode)));
+    rt_kprintf("registry: %u bytes\n", (unsigned)usage.registry);
+#ifdef UMCN_USING_HISTORY
+    rt_kprintf("history:  %u bytes\n", (unsigned)usage.history);
+#endif
+#ifdef UMCN_USING_VARSIZE
+    rt_kprintf("slab:     %u bytes\n", (unsigned)usage.slab);
+#endif
+    rt_kprintf("total:    %u bytes\n", (unsigned)usage.total);
+}
+
+#if defined(UMCN_USING_GRAPH) || defined(UMCN_USING_TRACE) || defined(UMCN_USING_RECORDER)
+static void console_output(void* ctx, const void* buf, rt_uint32_t len)
+{
+    rt_device_write(console_dev, 0, buf, len);
+}
+#endif
+
+#ifdef UMCN_USING_GRAPH
+static int graph_topic(struct optparse options)
+{
+    int option;
+    int format = MCN_GRAPH_DOT;
+    struct optparse_long longopts[] = {
+        { "help", 'h', OPTPARSE_NONE },
+        { "format", 'f', OPTPARSE_REQUIRED },
+        { RT_NULL } /* Don't remove this line */
+    };
+
+    while ((option = optparse_long(&options, longopts, RT_NULL)) != -1) {
+        switch (option) {
+        case 'h':
+            show_graph_usage();
+            return EXIT_SUCCESS;
+        case 'f':
+            if (STRING_COMPARE(options.optarg, "dot")) {
+                format = MCN_GRAPH_DOT;
+            } else if (STRING_COMPARE(options.optarg, "json")) {
+                format = MCN_GRAPH_JSON;
+            } else {
+                show_graph_usage();
+                return EXIT_FAILURE;
+            }
+            break;
+        case '?':
+            rt_kprintf("%s: %s\n", "mcn graph", options.errmsg);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return mcn_graph_export(format, console_output, RT_NULL) == RT_EOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#ifdef UMCN_USING_TRACE
+static int trace_topic(struct optparse options)
+{
+    char* arg = optparse_arg(&options);
+
+    if (arg == RT_NULL) {
+        show_trace_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (STRING_COMPARE(arg, "start")) {
+        mcn_trace_start();
+    } else if (STRING_COMPARE(arg, "stop")) {
+        mcn_trace_stop();
+    } else if (STRING_COMPARE(arg, "dump")) {
+        mcn_trace_dump(console_output, RT_NULL);
+    } else {
+        show_trace_usage();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+#endif
+
+#ifdef UMCN_USING_RECORDER
+static int dump_topic(struct optparse options)
+{
+    int option;
+    rt_bool_t resume = RT_FALSE;
+    struct optparse_long longopts[] = {
+        { "help", 'h', OPTPARSE_NONE },
+        { "resume", 'r', OPTPARSE_NONE },
+        { RT_NULL } /* Don't remove this line */
+    };
+
+    while ((option = optparse_long(&options, longopts, RT_NULL)) != -1) {
+        switch (option) {
+        case 'h':
+            show_dump_usage();
+            return EXIT_SUCCESS;
+        case 'r':
+            resume = RT_TRUE;
+            break;
+        case '?':
+            rt_kprintf("%s: %s\n", "mcn dump", options.errmsg);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* triggers the recorder if it's still recording */
+    if (mcn_recorder_dump(console_output, RT_NULL) != RT_EOK) {
+        return EXIT_FAILURE;
+    }
+
+    if (resume) {
+        mcn_recorder_resume();
+    }
+
+    return EXIT_SUCCESS;
+}
+#endif
+
 static int suspend_topic(struct optparse options)
 {
     char* arg;
@@ -161,19 +433,7 @@ static int suspend_topic(struct optparse options)
         return EXIT_FAILURE;
     }
 
-    McnList_t ite = mcn_get_list();
-    McnHub_t target_hub = RT_NULL;
-
-    while (1) {
-        McnHub_t hub = mcn_iterate(&ite);
-        if (hub == RT_NULL) {
-            break;
-        }
-        if (strcmp(hub->obj_name, arg) == 0) {
-            target_hub = hub;
-            break;
-        }
-    }
+    McnHub_t target_hub = mcn_find(arg);
 
     if (target_hub == RT_NULL) {
         rt_kprintf("can not find topic %s\n", arg);
@@ -181,6 +441,7 @@ static int suspend_topic(struct optparse options)
     }
 
     mcn_suspend(target_hub);
+    mcn_release(target_hub);
 
     return EXIT_SUCCESS;
 }
@@ -210,19 +471,7 @@ static int resume_topic(struct optparse options)
         return EXIT_FAILURE;
     }
 
-    McnList_t ite = mcn_get_list();
-    McnHub_t target_hub = RT_NULL;
-
-    while (1) {
-        McnHub_t hub = mcn_iterate(&ite);
-        if (hub == RT_NULL) {
-            break;
-        }
-        if (strcmp(hub->obj_name, arg) == 0) {
-            target_hub = hub;
-            break;
-        }
-    }
+    McnHub_t target_hub = mcn_find(arg);
 
     if (target_hub == RT_NULL) {
         rt_kprintf("can not find topic %s\n", arg);
@@ -230,6 +479,7 @@ static int resume_topic(struct optparse options)
     }
 
     mcn_resume(target_hub);
+    mcn_release(target_hub);
 
     return EXIT_SUCCESS;
 }
@@ -242,6 +492,7 @@ static int echo_topic(struct optparse options)
         { "help", 'h', OPTPARSE_NONE },
         { "number", 'n', OPTPARSE_REQUIRED },
         { "period", 'p', OPTPARSE_REQUIRED },
+        { "decimate", 'd', OPTPARSE_REQUIRED },
         { RT_NULL } /* Don't remove this line */
     };
 
@@ -251,6 +502,7 @@ static int echo_topic(struct optparse options)
     rt_uint32_t cnt = 1;
 #endif
     rt_uint32_t period = 500;
+    rt_uint32_t decimate = 1;
 
     while ((option = optparse_long(&options, longopts, RT_NULL)) != -1) {
         switch (option) {
@@ -263,6 +515,9 @@ static int echo_topic(struct optparse options)
         case 'p':
             period = atoi(options.optarg);
             break;
+        case 'd':
+            decimate = atoi(options.optarg);
+            break;
         case '?':
             rt_kprintf("%s: %s\n", "mcn echo", options.errmsg);
             return EXIT_FAILURE;
@@ -274,63 +529,317 @@ static int echo_topic(struct optparse options)
         return EXIT_FAILURE;
     }
 
-    McnList_t ite = mcn_get_list();
-    McnHub_t target_hub = RT_NULL;
-    while (1) {
-        McnHub_t hub = mcn_iterate(&ite);
-        if (hub == RT_NULL) {
+    if (decimate == 0) {
+        decimate = 1;
+    }
+
+    McnHub_t target_hub = mcn_find(arg);
+
+    if (target_hub == RT_NULL) {
+        rt_kprintf("can not find topic %s\n", arg);
+        return EXIT_FAILURE;
+    }
+
+    if (!has_echo(target_hub)) {
+        rt_kprintf("there is no topic echo function defined!\n");
+        mcn_release(target_hub);
+        return EXIT_FAILURE;
+    }
+
+#ifdef UMCN_USING_SCHEMA
+    void* data = RT_NULL;
+    char* text = RT_NULL;
+
+    if (HUB_ECHO(target_hub) == RT_NULL) {
+        /* echo through topic schema */
+        data = rt_malloc(target_hub->obj_size);
+        text = rt_malloc(ECHO_TEXT_SIZE);
+        if (data == RT_NULL || text == RT_NULL) {
+            rt_free(data);
+            rt_free(text);
+            rt_kprintf("out of memory\n");
+            mcn_release(target_hub);
+            return EXIT_FAILURE;
+        }
+    }
+#endif
+
+    rt_sem_t event = rt_sem_create("mcn_echo", 0, RT_IPC_FLAG_FIFO);
+    McnNode_t node = RT_NULL;
+
+    if (event != RT_NULL) {
+        node = mcn_subscribe(target_hub, event, RT_NULL);
+    }
+    /* subscribe node keeps the topic alive */
+    mcn_release(target_hub);
+
+    if (node == RT_NULL) {
+        rt_kprintf("mcn subscribe fail\n");
+        if (event != RT_NULL) {
+            rt_sem_delete(event);
+        }
+#ifdef UMCN_USING_SCHEMA
+        rt_free(data);
+        rt_free(text);
+#endif
+        return EXIT_FAILURE;
+    }
+
+    rt_uint32_t sample = 0;
+    rt_tick_t period_tick = rt_tick_from_millisecond(period);
+    rt_tick_t last_echo = rt_tick_get() - period_tick;
+
+    while (cnt) {
+        if (key_pressed()) {
             break;
         }
-        if (strcmp(hub->obj_name, arg) == 0) {
-            target_hub = hub;
+
+        if (!mcn_poll(node)) {
+            /* wait for topic published, wake up periodically to check key press */
+            mcn_poll_sync(node, rt_tick_from_millisecond(KEY_CHECK_PERIOD));
+            continue;
+        }
+        mcn_node_clear(node);
+
+        if (++sample < decimate) {
+            continue;
+        }
+        if (period && rt_tick_get() - last_echo < period_tick) {
+            continue;
+        }
+        sample = 0;
+        last_echo = rt_tick_get();
+
+#ifdef UMCN_USING_SCHEMA
+        if (HUB_ECHO(target_hub) == RT_NULL) {
+            /* echo through topic schema */
+            schema_echo(target_hub, data, text);
+        } else {
+            /* call custom echo function */
+            HUB_ECHO(target_hub)(target_hub);
+        }
+#else
+        /* call custom echo function */
+        HUB_ECHO(target_hub)(target_hub);
+#endif
+        cnt--;
+    }
+
+#ifdef UMCN_USING_SCHEMA
+    rt_free(data);
+    rt_free(text);
+#endif
+
+    if (mcn_unsubscribe(target_hub, node) != RT_EOK) {
+        rt_kprintf("mcn unsubscribe fail\n");
+        rt_sem_delete(event);
+        return EXIT_FAILURE;
+    }
+    rt_sem_delete(event);
+
+    return EXIT_SUCCESS;
+}
+
+static void monitor_update(struct monitor_stat* stat, rt_uint32_t len)
+{
+    rt_base_t level;
+    rt_uint64_t now = MCN_TIMESTAMP_US();
+
+    MCN_LOCK(level);
+    if (stat->last) {
+        rt_uint32_t interval = (rt_uint32_t)(now - stat->last);
+        double delta = interval - stat->interval_mean;
+
+        if (stat->interval_num == 0 || interval < stat->interval_min) {
+            stat->interval_min = interval;
+        }
+        if (interval > stat->interval_max) {
+            stat->interval_max = interval;
+        }
+        /* Welford's method, keeps precision with many samples of large timestamps */
+        stat->interval_num++;
+        stat->interval_mean += delta / stat->interval_num;
+        stat->interval_m2 += delta * (interval - stat->interval_mean);
+    }
+    stat->last = now;
+    stat->count++;
+    stat->bytes += len;
+    MCN_UNLOCK(level);
+}
+
+/* publish callback has no user parameter, so each monitor slot has its own */
+#define MONITOR_PUB_CB(i)                                                    \
+    static void monitor_pub_cb_##i(void* parameter)                          \
+    {                                                                        \
+        monitor_update(&monitor[i], MCN_DATA_LEN(monitor_hub[i], parameter)); \
+    }
+
+MONITOR_PUB_CB(0)
+MONITOR_PUB_CB(1)
+MONITOR_PUB_CB(2)
+MONITOR_PUB_CB(3)
+
+static void (*const monitor_pub_cb[MONITOR_MAX_NUM])(void* parameter) = {
+    monitor_pub_cb_0,
+    monitor_pub_cb_1,
+    monitor_pub_cb_2,
+    monitor_pub_cb_3,
+};
+
+static void monitor_report(int mode, const struct monitor_stat* stat, rt_uint64_t elapsed)
+{
+    float rate = elapsed ? (float)stat->count * 1e6f / elapsed : 0.0f;
+
+    if (mode == MONITOR_HZ) {
+        if (stat->interval_num == 0) {
+            list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "average rate: %.3f Hz\n", rate);
+            return;
+        }
+        double var = stat->interval_m2 / stat->interval_num;
+
+        list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "average rate: %.3f Hz\n", rate);
+        list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "\tmin: %.3fms max: %.3fms std dev: %.3fms window: %u\n",
+            stat->interval_min / 1000.0f, stat->interval_max / 1000.0f,
+            (var > 0.0 ? sqrt(var) : 0.0) / 1000.0, (unsigned)stat->count);
+    } else if (mode == MONITOR_BW) {
+        float bw = elapsed ? (float)stat->bytes * 1e6f / elapsed : 0.0f;
+
+        if (bw >= 1024.0f * 1024.0f) {
+            list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "average: %.2f MB/s\n", bw / (1024.0f * 1024.0f));
+        } else if (bw >= 1024.0f) {
+            list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "average: %.2f KB/s\n", bw / 1024.0f);
+        } else {
+            list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "average: %.2f B/s\n", bw);
+        }
+        list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "\tmean: %u B/msg window: %u\n",
+            (unsigned)(stat->count ? stat->bytes / stat->count : 0), (unsigned)stat->count);
+    } else {
+        if (stat->last == 0) {
+            rt_kprintf("no new messages\n");
+            return;
+        }
+        list_printf(' ', 0, SYSCMD_ALIGN_LEFT, "age of last sample: %.3fms window: %u\n",
+            (MCN_TIMESTAMP_US() - stat->last) / 1000.0f, (unsigned)stat->count);
+    }
+}
+
+static int monitor_topic(struct optparse options, int mode)
+{
+    static const char* const cmd_name[] = { "mcn hz", "mcn bw", "mcn delay" };
+    char* arg;
+    int option;
+    int slot;
+    rt_base_t level;
+    struct monitor_stat* stat_slot;
+    struct optparse_long longopts[] = {
+        { "help", 'h', OPTPARSE_NONE },
+        { "number", 'n', OPTPARSE_REQUIRED },
+        { "window", 'w', OPTPARSE_REQUIRED },
+        { RT_NULL } /* Don't remove this line */
+    };
+
+#if defined(RT_USING_DEVICE) && !defined(RT_USING_POSIX)
+    rt_uint32_t cnt = 0xFFFFFFFF;
+#else
+    rt_uint32_t cnt = 1;
+#endif
+    rt_uint32_t window = 1000;
+
+    while ((option = optparse_long(&options, longopts, RT_NULL)) != -1) {
+        switch (option) {
+        case 'h':
+            show_monitor_usage(cmd_name[mode]);
+            return EXIT_SUCCESS;
+        case 'n':
+            cnt = atoi(options.optarg);
             break;
+        case 'w':
+            window = atoi(options.optarg);
+            break;
+        case '?':
+            rt_kprintf("%s: %s\n", cmd_name[mode], options.errmsg);
+            return EXIT_FAILURE;
         }
     }
 
+    if ((arg = optparse_arg(&options)) == RT_NULL || window == 0) {
+        show_monitor_usage(cmd_name[mode]);
+        return EXIT_FAILURE;
+    }
+
+    McnHub_t target_hub = mcn_find(arg);
+
     if (target_hub == RT_NULL) {
         rt_kprintf("can not find topic %s\n", arg);
         return EXIT_FAILURE;
     }
 
-    if (target_hub->echo == RT_NULL) {
-        rt_kprintf("there is no topic echo function defined!\n");
+    MCN_LOCK(level);
+    for (slot = 0; slot < MONITOR_MAX_NUM && monitor_used[slot]; slot++) {
+    }
+    if (slot < MONITOR_MAX_NUM) {
+        monitor_used[slot] = RT_TRUE;
+        monitor_hub[slot] = target_hub;
+    }
+    MCN_UNLOCK(level);
+
+    if (slot == MONITOR_MAX_NUM) {
+        mcn_release(target_hub);
+        rt_kprintf("too many topic monitors\n");
         return EXIT_FAILURE;
     }
+    stat_slot = &monitor[slot];
 
-    McnNode_t node = mcn_subscribe(target_hub, RT_NULL, RT_NULL);
+    McnNode_t node = mcn_subscribe(target_hub, RT_NULL, monitor_pub_cb[slot]);
+    /* subscribe node keeps the topic alive */
+    mcn_release(target_hub);
 
     if (node == RT_NULL) {
+        monitor_used[slot] = RT_FALSE;
         rt_kprintf("mcn subscribe fail\n");
         return EXIT_FAILURE;
     }
 
+    /* drop the sample delivered on subscribe */
+    MCN_LOCK(level);
+    memset(stat_slot, 0, sizeof(*stat_slot));
+    MCN_UNLOCK(level);
+
+    rt_uint64_t window_start = MCN_TIMESTAMP_US();
+    rt_uint32_t waited = 0;
+
     while (cnt) {
-#if !defined(RT_USING_POSIX_STDIO) && defined(RT_USING_DEVICE)
-        /* type any key to exit */
-        if (rt_sem_trytake(&shell->rx_sem) == RT_EOK) {
-            int ch;
-            while (rt_device_read(shell->device, -1, &ch, 1) == 1)
-                ;
+        if (key_pressed()) {
             break;
         }
-#endif
 
-        if (mcn_poll(node)) {
-            /* call custom echo function */
-            target_hub->echo(target_hub);
-            mcn_node_clear(node);
-            cnt--;
+        rt_thread_mdelay(KEY_CHECK_PERIOD);
+        waited += KEY_CHECK_PERIOD;
+        if (waited < window) {
+            continue;
         }
+        waited = 0;
 
-        if (period) {
-            usleep(period * 1000);
-        }
+        struct monitor_stat stat;
+        rt_uint64_t now = MCN_TIMESTAMP_US();
+
+        MCN_LOCK(level);
+        stat = *stat_slot;
+        /* start a new window, keep last timestamp for interval and age */
+        memset(stat_slot, 0, sizeof(*stat_slot));
+        stat_slot->last = stat.last;
+        MCN_UNLOCK(level);
+
+        monitor_report(mode, &stat, now - window_start);
+        window_start = now;
+        cnt--;
     }
 
     if (mcn_unsubscribe(target_hub, node) != RT_EOK) {
         rt_kprintf("mcn unsubscribe fail\n");
         return EXIT_FAILURE;
     }
+    monitor_used[slot] = RT_FALSE;
 
     return EXIT_SUCCESS;
 }
@@ -351,10 +860,30 @@ int cmd_mcn(int argc, char** argv)
             list_topic();
         } else if (STRING_COMPARE(arg, "echo")) {
             res = echo_topic(options);
+        } else if (STRING_COMPARE(arg, "hz")) {
+            res = monitor_topic(options, MONITOR_HZ);
+        } else if (STRING_COMPARE(arg, "bw")) {
+            res = monitor_topic(options, MONITOR_BW);
+        } else if (STRING_COMPARE(arg, "delay")) {
+            res = monitor_topic(options, MONITOR_DELAY);
+#ifdef UMCN_USING_GRAPH
+        } else if (STRING_COMPARE(arg, "graph")) {
+            res = graph_topic(options);
+#endif
+#ifdef UMCN_USING_TRACE
+        } else if (STRING_COMPARE(arg, "trace")) {
+            res = trace_topic(options);
+#endif
+#ifdef UMCN_USING_RECORDER
+        } else if (STRING_COMPARE(arg, "dump")) {
+            res = dump_topic(options);
+#endif
         } else if (STRING_COMPARE(arg, "suspend")) {
             res = suspend_topic(options);
         } else if (STRING_COMPARE(arg, "resume")) {
             res = resume_topic(options);
+        } else if (STRING_COMPARE(arg, "mem")) {
+            mem_topic();
         } else {
             show_usage();
         }
@@ -0,0 +1,265 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/* names are written by graph_name(), so formatted lines have bounded length */
+#define GRAPH_LINE_SIZE 128
+
+struct graph_edge {
+    char owner[RT_NAME_MAX + 1];
+    rt_uint32_t delivered;
+    rt_uint32_t dropped;
+    rt_uint64_t cb_time;
+};
+
+static void graph_printf(McnOutput_t output, void* ctx, const char* fmt, ...)
+{
+    char line[GRAPH_LINE_SIZE];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return;
+    }
+    MCN_ASSERT(len < (int)sizeof(line));
+
+    output(ctx, line, len);
+}
+
+/**
+ * @brief Output a topic or owner name inside a quoted DOT/JSON string
+ * @note '"' and '\' are escaped, which is the same in both formats
+ */
+static void graph_name(McnOutput_t output, void* ctx, const char* name)
+{
+    const char* run = name;
+
+    for (; *name != '\0'; name++) {
+        if (*name == '"' || *name == '\\') {
+            if (name > run) {
+                output(ctx, run, name - run);
+            }
+            output(ctx, "\\", 1);
+            /* the escaped character starts next run */
+            run = name;
+        }
+    }
+
+    if (name > run) {
+        output(ctx, run, name - run);
+    }
+}
+
+/**
+ * @brief Get the i-th subscribe edge of hub
+ * @note The node is looked up and copied with hub locked, so the output
+ * function can be called without holding the lock
+ *
+ * @return rt_bool_t RT_TRUE if the edge exists
+ */
+static rt_bool_t graph_get_edge(McnHub_t hub, rt_uint32_t index, struct graph_edge* edge)
+{
+    McnNode_t node;
+    rt_base_t level;
+
+    MCN_HUB_LOCK(hub, level);
+    for (node = hub->link_head; node != RT_NULL && index; node = node->next) {
+        index--;
+    }
+    if (node != RT_NULL) {
+        rt_memcpy(edge->owner, node->owner, RT_NAME_MAX);
+        edge->owner[RT_NAME_MAX] = '\0';
+        edge->delivered = node->delivered;
+        edge->dropped = node->dropped;
+        edge->cb_time = node->cb_time;
+    }
+    MCN_HUB_UNLOCK(hub, level);
+
+    return node != RT_NULL ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Get the i-th publisher of hub
+ *
+ * @return rt_bool_t RT_TRUE if the publisher exists
+ */
+static rt_bool_t graph_get_publisher(McnHub_t hub, rt_uint32_t index, struct graph_edge* edge)
+{
+    rt_bool_t exist = RT_FALSE;
+    rt_base_t level;
+
+    MCN_HUB_LOCK(hub, level);
+    if (index < MCN_MAX_PUBLISHER_NUM && hub->publisher[index].owner[0] != '\0') {
+        rt_memcpy(edge->owner, hub->publisher[index].owner, RT_NAME_MAX);
+        edge->owner[RT_NAME_MAX] = '\0';
+        edge->delivered = hub->publisher[index].published;
+        exist = RT_TRUE;
+    }
+    MCN_HUB_UNLOCK(hub, level);
+
+    return exist;
+}
+
+static void graph_export_dot(McnOutput_t output, void* ctx)
+{
+    struct graph_edge edge;
+    McnList_t ite = mcn_get_list();
+
+    graph_printf(output, ctx, "digraph mcn {\n  rankdir=LR;\n");
+
+    for (McnHub_t hub = mcn_iterate(&ite); hub != RT_NULL; hub = mcn_iterate(&ite)) {
+        /* topics without subscriber are dashed */
+        graph_printf(output, ctx, "  \"t:");
+        graph_name(output, ctx, hub->obj_name);
+        graph_printf(output, ctx, "\" [label=\"");
+        graph_name(output, ctx, hub->obj_name);
+        graph_printf(output, ctx, "\\n%.1fHz\" shape=box%s];\n",
+            mcn_get_freq(hub), hub->link_num ? "" : " style=dashed");
+
+        for (rt_uint32_t i = 0; graph_get_publisher(hub, i, &edge); i++) {
+            graph_printf(output, ctx, "  \"");
+            graph_name(output, ctx, edge.owner);
+            graph_printf(output, ctx, "\" -> \"t:");
+            graph_name(output, ctx, hub->obj_name);
+            graph_printf(output, ctx, "\" [label=\"pub:%lu\"];\n", (unsigned long)edge.delivered);
+        }
+
+        for (rt_uint32_t i = 0; graph_get_edge(hub, i, &edge); i++) {
+            graph_printf(output, ctx, "  \"t:");
+            graph_name(output, ctx, hub->obj_name);
+            graph_printf(output, ctx, "\" -> \"");
+            graph_name(output, ctx, edge.owner);
+            graph_printf(output, ctx, "\" [label=\"dlv:%lu drop:%lu cb:%lluus\"];\n",
+                (unsigned long)edge.delivered, (unsigned long)edge.dropped, (unsigned long long)edge.cb_time);
+        }
+    }
+
+    graph_printf(output, ctx, "}\n");
+}
+
+static void graph_export_json(McnOutput_t output, void* ctx)
+{
+    struct graph_edge edge;
+    McnList_t ite = mcn_get_list();
+    rt_bool_t first_hub = RT_TRUE;
+
+    graph_printf(output, ctx, "{\"topics\":[");
+
+    for (McnHub_t hub = mcn_iterate(&ite); hub != RT_NULL; hub = mcn_iterate(&ite)) {
+        graph_printf(output, ctx, "%s\n{\"name\":\"", first_hub ? "" : ",");
+        graph_name(output, ctx, hub->obj_name);
+        graph_printf(output, ctx, "\",\"size\":%lu,\"freq\":%.1f,\"publishers\":[",
+            (unsigned long)hub->obj_size, mcn_get_freq(hub));
+        first_hub = RT_FALSE;
+
+        for (rt_uint32_t i = 0; graph_get_publisher(hub, i, &edge); i++) {
+            graph_printf(output, ctx, "%s{\"owner\":\"", i ? "," : "");
+            graph_name(output, ctx, edge.owner);
+            graph_printf(output, ctx, "\",\"published\":%lu}", (unsigned long)edge.delivered);
+        }
+
+        graph_printf(output, ctx, "],\"subscribers\":[");
+
+        for (rt_uint32_t i = 0; graph_get_edge(hub, i, &edge); i++) {
+            graph_printf(output, ctx, "%s{\"owner\":\"", i ? "," : "");
+            graph_name(output, ctx, edge.owner);
+            graph_printf(output, ctx, "\",\"delivered\":%lu,\"dropped\":%lu,\"cb_time_us\":%llu}",
+                (unsigned long)edge.delivered, (unsigned long)edge.dropped, (unsigned long long)edge.cb_time);
+        }
+
+        graph_printf(output, ctx, "]}");
+    }
+
+    graph_printf(output, ctx, "\n]}\n");
+}
+
+/**
+ * @brief Account a publish to the publisher of current context
+ * @note Must be called with hub locked
+ *
+ * @param hub uMCN hub
+ */
+void mcn_graph_publish(McnHub_t hub)
+{
+    char owner[RT_NAME_MAX];
+
+    mcn_get_owner(owner);
+
+    for (int i = 0; i < MCN_MAX_PUBLISHER_NUM; i++) {
+        McnPublisher* pub = &hub->publisher[i];
+
+        if (pub->owner[0] == '\0') {
+            /* new publisher */
+            rt_memcpy(pub->owner, owner, RT_NAME_MAX);
+            pub->published = 1;
+            return;
+        }
+        if (rt_strncmp(pub->owner, owner, RT_NAME_MAX) == 0) {
+            pub->published++;
+            return;
+        }
+    }
+    /* publisher table is full, extra publishers are not tracked */
+}
+
+/**
+ * @brief Set owner name of a subscribe node
+ * @note The owner is the subscribing thread name by default
+ *
+ * @param node_t uMCN node
+ * @param owner Owner name, e.g, module name
+ */
+void mcn_node_set_owner(McnNode_t node_t, const char* owner)
+{
+    MCN_ASSERT(node_t != RT_NULL);
+    MCN_ASSERT(owner != RT_NULL);
+
+    rt_strncpy(node_t->owner, owner, RT_NAME_MAX);
+}
+
+/**
+ * @brief Export topic graph with per-edge traffic counters
+ *
+ * @param format MCN_GRAPH_DOT or MCN_GRAPH_JSON
+ * @param output Output function
+ * @param ctx Context passed to output function
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_graph_export(int format, McnOutput_t output, void* ctx)
+{
+    MCN_ASSERT(output != RT_NULL);
+
+    if (format == MCN_GRAPH_DOT) {
+        graph_export_dot(output, ctx);
+    } else if (format == MCN_GRAPH_JSON) {
+        graph_export_json(output, ctx);
+    } else {
+        return -RT_EINVAL;
+    }
+
+    return RT_EOK;
+}
@@ -0,0 +1,354 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/*
+ * A group owns one subscribe node per member topic. Publishing a member marks
+ * its bit in the group under the hub lock, the group becomes ready once all
+ * bits are set. Lock order is always hub(s) -> group, multiple hubs are locked
+ * in ascending address order, so copying a group can't deadlock against
+ * publishers or another group sharing some of the topics.
+ */
+#ifdef RT_USING_SMP
+#define GROUP_LOCK(group, level)   ((level) = rt_spin_lock_irqsave(&(group)->lock))
+#define GROUP_UNLOCK(group, level) rt_spin_unlock_irqrestore(&(group)->lock, level)
+#else
+#define GROUP_LOCK(group, level)   ((level) = 0, rt_enter_critical())
+#define GROUP_UNLOCK(group, level) ((void)(level), rt_exit_critical())
+#endif
+
+#define GROUP_FULL_MASK(group) ((1UL << (group)->member_num) - 1)
+
+/**
+ * @brief Drop members whose sample is too old compared to the newest one
+ * @note Must be called with group locked and all members updated
+ */
+static void group_check_tolerance(McnGroup_t group)
+{
+    rt_uint64_t newest = 0;
+    int i;
+
+    if (group->tolerance == 0) {
+        return;
+    }
+
+    for (i = 0; i < group->member_num; i++) {
+        if (group->stamp[i] > newest) {
+            newest = group->stamp[i];
+        }
+    }
+
+    for (i = 0; i < group->member_num; i++) {
+        if (newest - group->stamp[i] > group->tolerance) {
+            /* wait for a fresher sample of this member */
+            group->updated &= ~(1UL << i);
+        }
+    }
+}
+
+/**
+ * @brief Mark a group member as updated
+ * @note Called by publisher with hub locked
+ *
+ * @param hub Member hub
+ * @param node Subscribe node of the group
+ */
+void mcn_group_update(McnHub_t hub, McnNode_t node)
+{
+    McnGroup_t group = node->group;
+    rt_bool_t wakeup = RT_FALSE;
+    rt_base_t level;
+
+    GROUP_LOCK(group, level);
+
+#ifdef MCN_HUB_TIMESTAMP
+    group->stamp[node->group_index] = hub->timestamp;
+#else
+    group->stamp[node->group_index] = MCN_TIMESTAMP_US();
+#endif
+    group->updated |= 1UL << node->group_index;
+
+    if (!group->ready && group->updated == GROUP_FULL_MASK(group)) {
+        group_check_tolerance(group);
+
+        if (group->updated == GROUP_FULL_MASK(group)) {
+            group->ready = 1;
+            group->pending = group->cb != RT_NULL;
+            wakeup = RT_TRUE;
+        }
+    }
+
+    GROUP_UNLOCK(group, level);
+
+    if (wakeup && group->event != RT_NULL) {
+        /* stimulate as mutex */
+        if (group->event->value == 0)
+            MCN_SEND_EVENT(group->event);
+    }
+}
+
+/**
+ * @brief Invoke group callback if it's pending
+ * @note Called by publisher after the member hub is unlocked
+ *
+ * @param group uMCN group
+ */
+void mcn_group_invoke(McnGroup_t group)
+{
+    rt_bool_t pending;
+    rt_base_t level;
+
+    GROUP_LOCK(group, level);
+    pending = group->pending;
+    group->pending = 0;
+    GROUP_UNLOCK(group, level);
+
+    if (pending) {
+        group->cb(group, group->parameter);
+    }
+}
+
+/**
+ * @brief Initialize a topic group
+ * @note A group wakes up its user once when every member topic has a new sample,
+ * so that data from several topics can be consumed together
+ *
+ * @param group uMCN group
+ * @param event Event handle to be released when group is ready, can be RT_NULL
+ * @param tolerance_us Maximal timestamp difference (us) among member samples, 0 to disable.
+ * Member samples older than this compared to the newest one are waited again
+ * @param cb Callback when group is ready, can be RT_NULL. It's called from publisher's context
+ * @param parameter User parameter of callback
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_group_init(McnGroup_t group, MCN_EVENT_HANDLE event, rt_uint32_t tolerance_us,
+    void (*cb)(McnGroup_t group, void* parameter), void* parameter)
+{
+    MCN_ASSERT(group != RT_NULL);
+
+    rt_memset(group, 0, sizeof(McnGroup));
+    group->event = event;
+    group->tolerance = tolerance_us;
+    group->cb = cb;
+    group->parameter = parameter;
+#ifdef RT_USING_SMP
+    rt_spin_lock_init(&group->lock);
+#endif
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Add a topic into group
+ * @note Members should be added before the group is used
+ *
+ * @param group uMCN group
+ * @param hub uMCN hub
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_group_add(McnGroup_t group, McnHub_t hub)
+{
+    McnNode_t node;
+    rt_uint8_t index;
+    int i;
+    rt_base_t level, group_level;
+
+    MCN_ASSERT(group != RT_NULL);
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (group->member_num >= MCN_GROUP_MAX_MEMBER) {
+        return -RT_EFULL;
+    }
+
+    for (i = 0; i < group->member_num; i++) {
+        if (group->hub[i] == hub) {
+            /* topic is already a member */
+            return -RT_EBUSY;
+        }
+    }
+
+    node = mcn_subscribe(hub, RT_NULL, RT_NULL);
+    if (node == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+    index = group->member_num;
+    group->hub[index] = hub;
+    group->node[index] = node;
+
+    /* keep members sorted by hub address */
+    for (i = index; i > 0 && group->hub[group->order[i - 1]] > hub; i--) {
+        group->order[i] = group->order[i - 1];
+    }
+    group->order[i] = index;
+
+    MCN_HUB_LOCK(hub, level);
+    GROUP_LOCK(group, group_level);
+    node->group_index = index;
+    node->group = group;
+    group->member_num++;
+    if (hub->published) {
+        /* the last sample counts as an update, like a normal subscriber */
+#ifdef MCN_HUB_TIMESTAMP
+        group->stamp[index] = hub->timestamp;
+#else
+        group->stamp[index] = MCN_TIMESTAMP_US();
+#endif
+        group->updated |= 1UL << index;
+    }
+    if (group->updated == GROUP_FULL_MASK(group)) {
+        group_check_tolerance(group);
+    }
+    group->ready = group->updated == GROUP_FULL_MASK(group);
+    GROUP_UNLOCK(group, group_level);
+    MCN_HUB_UNLOCK(hub, level);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Poll for group status
+ *
+ * @param group uMCN group
+ * @return rt_bool_t RT_TRUE if all members have been updated
+ */
+rt_bool_t mcn_group_poll(McnGroup_t group)
+{
+    MCN_ASSERT(group != RT_NULL);
+
+    return group->ready ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Synchronize poll for group status
+ * @note event must has been provided when initialize the group
+ *
+ * @param group uMCN group
+ * @param timeout Wait timeout
+ * @return rt_bool_t RT_TRUE if all members have been updated
+ */
+rt_bool_t mcn_group_poll_sync(McnGroup_t group, rt_int32_t timeout)
+{
+    MCN_ASSERT(group != RT_NULL);
+    MCN_ASSERT(group->event != RT_NULL);
+
+    if (group->ready) {
+        /* consume the event released for current samples */
+        MCN_WAIT_EVENT(group->event, 0);
+        return RT_TRUE;
+    }
+
+    if (MCN_WAIT_EVENT(group->event, timeout) != 0) {
+        return RT_FALSE;
+    }
+
+    return group->ready ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Copy data of all group members
+ * @note All member hubs are locked during copy, so the samples are consistent,
+ * i.e, no member can be published in between. This function clears the update
+ * status of group
+ *
+ * @param group uMCN group
+ * @param buffer Buffers to receive member data, in the order members were added
+ * @param len Receives length of each member data, can be RT_NULL if no member
+ * is variable size
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_group_copy(McnGroup_t group, void* const buffer[], rt_uint32_t len[])
+{
+    int i;
+    /* interrupt status saved by each member lock, restored in reverse order */
+    rt_base_t level[MCN_GROUP_MAX_MEMBER];
+    rt_base_t group_level;
+
+    MCN_ASSERT(group != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    for (i = 0; i < group->member_num; i++) {
+        MCN_ASSERT(buffer[i] != RT_NULL);
+        /* length of variable size member must be returned */
+        MCN_ASSERT(len != RT_NULL || !MCN_HUB_VARSIZE(group->hub[i]));
+
+        if (!group->hub[i]->published) {
+            /* copy before published */
+            return -RT_ERROR;
+        }
+    }
+
+    for (i = 0; i < group->member_num; i++) {
+        MCN_HUB_LOCK(group->hub[group->order[i]], level[i]);
+    }
+    GROUP_LOCK(group, group_level);
+
+    for (i = 0; i < group->member_num; i++) {
+        McnHub_t hub = group->hub[i];
+        McnNode_t node = group->node[i];
+
+        rt_uint32_t data_len = MCN_HUB_DATA_LEN(hub);
+
+        mcn_memcpy(buffer[i], hub->pdata, data_len);
+        if (len != RT_NULL) {
+            len[i] = data_len;
+        }
+        MCN_NODE_CLEAR_RENEWAL(node);
+#ifdef UMCN_USING_PARTIAL
+        node->dirty = 0;
+#endif
+    }
+    group->updated = 0;
+    group->ready = 0;
+
+    GROUP_UNLOCK(group, group_level);
+    for (i = group->member_num - 1; i >= 0; i--) {
+        MCN_HUB_UNLOCK(group->hub[group->order[i]], level[i]);
+    }
+
+    for (i = 0; i < group->member_num; i++) {
+        MCN_TRACE(MCN_TRACE_COPY, group->hub[i]);
+    }
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Unsubscribe all members of group
+ * @note The group can be reused after calling mcn_group_init() again
+ *
+ * @param group uMCN group
+ */
+void mcn_group_detach(McnGroup_t group)
+{
+    int i;
+
+    MCN_ASSERT(group != RT_NULL);
+
+    for (i = 0; i < group->member_num; i++) {
+        mcn_unsubscribe(group->hub[i], group->node[i]);
+        group->hub[i] = RT_NULL;
+        group->node[i] = RT_NULL;
+    }
+    group->member_num = 0;
+    group->updated = 0;
+    group->ready = 0;
+    group->pending = 0;
+}
@@ -0,0 +1,199 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+struct mcn_history {
+    rt_uint16_t depth;
+    /* index of the slot to be written next */
+    rt_uint16_t head;
+    rt_uint16_t count;
+    void (*interp)(const void* prev, const void* next, float ratio, void* out);
+    /* timestamps are kept apart from payloads so the binary search
+     * only touches a small contiguous array */
+    rt_uint64_t* stamp;
+    rt_uint8_t* data;
+};
+
+/**
+ * @brief Convert logical index (0 is the oldest sample) to ring slot
+ */
+rt_inline rt_uint16_t history_slot(const struct mcn_history* hist, rt_uint16_t idx)
+{
+    rt_uint32_t slot = (rt_uint32_t)hist->head + hist->depth - hist->count + idx;
+
+    return slot % hist->depth;
+}
+
+/**
+ * @brief Push current hub data into history ring
+ * @note Must be called with hub locked, after hub data updated
+ *
+ * @param hub uMCN hub
+ * @param timestamp Sample timestamp (us)
+ */
+void mcn_history_push(McnHub_t hub, rt_uint64_t timestamp)
+{
+    struct mcn_history* hist = hub->history;
+
+    if (hist == RT_NULL) {
+        return;
+    }
+
+    hist->stamp[hist->head] = timestamp;
+    mcn_memcpy(&hist->data[hist->head * hub->obj_size], hub->pdata, hub->obj_size);
+
+    hist->head = (hist->head + 1) % hist->depth;
+    if (hist->count < hist->depth) {
+        hist->count++;
+    }
+}
+
+/**
+ * @brief Get memory size used by history ring
+ *
+ * @param hub uMCN hub
+ * @return rt_uint32_t Size in bytes, 0 if history is not enabled
+ */
+rt_uint32_t mcn_history_size(McnHub_t hub)
+{
+    struct mcn_history* hist = hub->history;
+
+    if (hist == RT_NULL) {
+        return 0;
+    }
+
+    return RT_ALIGN(sizeof(struct mcn_history), sizeof(rt_uint64_t))
+        + hist->depth * (sizeof(rt_uint64_t) + hub->obj_size);
+}
+
+/**
+ * @brief Enable timestamped history for a uMCN topic
+ * @note Each published sample is kept in a ring of depth entries
+ *
+ * @param hub uMCN hub
+ * @param depth Number of samples to keep
+ * @param interp Interpolation function, can be RT_NULL. It is called with the
+ * samples before and after the requested timestamp and the ratio in [0, 1]
+ * between them. If not provided, the sample before the timestamp is returned
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_history_enable(McnHub_t hub, rt_uint16_t depth,
+    void (*interp)(const void* prev, const void* next, float ratio, void* out))
+{
+    struct mcn_history* hist;
+    rt_base_t level;
+    rt_uint32_t stamp_offset = RT_ALIGN(sizeof(struct mcn_history), sizeof(rt_uint64_t));
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (depth == 0 || MCN_HUB_VARSIZE(hub)) {
+        /* history slots have fixed size */
+        return -RT_EINVAL;
+    }
+
+    if (hub->history != RT_NULL) {
+        /* already enabled */
+        return -RT_ERROR;
+    }
+
+    hist = (struct mcn_history*)MCN_MALLOC(stamp_offset + depth * (sizeof(rt_uint64_t) + hub->obj_size));
+    if (hist == RT_NULL) {
+        return -RT_ENOMEM;
+    }
+
+    hist->depth = depth;
+    hist->head = 0;
+    hist->count = 0;
+    hist->interp = interp;
+    hist->stamp = (rt_uint64_t*)((rt_uint8_t*)hist + stamp_offset);
+    hist->data = (rt_uint8_t*)(hist->stamp + depth);
+
+    MCN_HUB_LOCK(hub, level);
+    hub->history = hist;
+    MCN_HUB_UNLOCK(hub, level);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Copy topic data at a given timestamp from history
+ * @note If timestamp is newer than the latest sample, the latest sample is copied.
+ * The interpolation function is invoked with hub locked, keep it short.
+ *
+ * @param hub uMCN hub
+ * @param timestamp Timestamp (us) to look up
+ * @param buffer buffer to received the data
+ * @return rt_err_t RT_EOK indicates success, -RT_EEMPTY if no sample recorded,
+ * -RT_ERROR if timestamp is older than the oldest sample
+ */
+rt_err_t mcn_copy_at(McnHub_t hub, rt_uint64_t timestamp, void* buffer)
+{
+    struct mcn_history* hist;
+    rt_err_t err = RT_EOK;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    hist = hub->history;
+    if (hist == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+    MCN_HUB_LOCK(hub, level);
+
+    if (hist->count == 0) {
+        err = -RT_EEMPTY;
+    } else if (timestamp < hist->stamp[history_slot(hist, 0)]) {
+        err = -RT_ERROR;
+    } else {
+        /* find the last sample whose timestamp <= requested timestamp */
+        rt_uint16_t lo = 0;
+        rt_uint16_t hi = hist->count - 1;
+
+        while (lo < hi) {
+            rt_uint16_t mid = (lo + hi + 1) / 2;
+
+            if (hist->stamp[history_slot(hist, mid)] <= timestamp) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        rt_uint16_t prev = history_slot(hist, lo);
+        const void* prev_data = &hist->data[prev * hub->obj_size];
+
+        if (hist->interp != RT_NULL && lo + 1 < hist->count && hist->stamp[prev] != timestamp) {
+            rt_uint16_t next = history_slot(hist, lo + 1);
+            float ratio = (float)(timestamp - hist->stamp[prev]) / (float)(hist->stamp[next] - hist->stamp[prev]);
+
+            hist->interp(prev_data, &hist->data[next * hub->obj_size], ratio, buffer);
+        } else {
+            mcn_memcpy(buffer, prev_data, hub->obj_size);
+        }
+    }
+
+    MCN_HUB_UNLOCK(hub, level);
+
+    return err;
+}
@@ -0,0 +1,156 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#ifndef MCN_INTERNAL_H__
+#define MCN_INTERNAL_H__
+
+#include <uMCN.h>
+#ifdef UMCN_USING_VARSIZE
+#include <stddef.h>
+#endif
+
+/* Internal interfaces shared by uMCN modules, not part of the public API */
+
+#ifdef RT_USING_SMP
+/* global spinlock guards topic list, interrupts are disabled as MCN_HUB_LOCK() */
+extern struct rt_spinlock __mcn_lock;
+#define MCN_LOCK(level)   ((level) = rt_spin_lock_irqsave(&__mcn_lock))
+#define MCN_UNLOCK(level) rt_spin_unlock_irqrestore(&__mcn_lock, level)
+#else
+#define MCN_LOCK(level)   ((level) = 0, rt_enter_critical())
+#define MCN_UNLOCK(level) ((void)(level), rt_exit_critical())
+#endif
+
+#ifdef UMCN_USING_CACHE_ALIGN
+typedef rt_uint64_t __attribute__((__may_alias__)) mcn_word_t;
+#endif
+
+/**
+ * @brief Copy topic data
+ * @note With UMCN_USING_CACHE_ALIGN, aligned buffers are copied in 64-bit words
+ */
+rt_inline void mcn_memcpy(void* dst, const void* src, rt_uint32_t size)
+{
+#ifdef UMCN_USING_CACHE_ALIGN
+    if ((((rt_ubase_t)dst | (rt_ubase_t)src) & (sizeof(mcn_word_t) - 1)) == 0) {
+        mcn_word_t* d = (mcn_word_t*)dst;
+        const mcn_word_t* s = (const mcn_word_t*)src;
+
+        for (; size >= 4 * sizeof(mcn_word_t); size -= 4 * sizeof(mcn_word_t)) {
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            d[3] = s[3];
+            d += 4;
+            s += 4;
+        }
+        for (; size >= sizeof(mcn_word_t); size -= sizeof(mcn_word_t)) {
+            *d++ = *s++;
+        }
+
+        dst = d;
+        src = s;
+    }
+#endif
+    if (size) {
+        rt_memcpy(dst, src, size);
+    }
+}
+
+rt_err_t mcn_hub_get(McnHub_t hub);
+
+#ifdef UMCN_USING_HISTORY
+void mcn_history_push(McnHub_t hub, rt_uint64_t timestamp);
+rt_uint32_t mcn_history_size(McnHub_t hub);
+#endif
+
+#ifdef UMCN_USING_WATCH
+int mcn_watch_init(void);
+#endif
+
+#ifdef UMCN_USING_VARSIZE
+struct mcn_buf {
+    /* held by hub, running publish callbacks and borrowers */
+    rt_uint32_t ref;
+    /* length of data */
+    rt_uint32_t len;
+    /* size class, MCN_SLAB_CLASS_NUM if too large to be cached */
+    rt_uint8_t cls;
+    /* next free buffer in the same size class */
+    struct mcn_buf* next;
+    rt_uint64_t data[];
+};
+/* Get slab buffer from its data pointer */
+#define MCN_BUF_OF(_data) ((struct mcn_buf*)((rt_uint8_t*)(_data) - offsetof(struct mcn_buf, data)))
+#define MCN_HUB_VARSIZE(hub)  ((hub)->varsize)
+/* Length of the topic data currently held by hub */
+#define MCN_HUB_DATA_LEN(hub) ((hub)->varsize ? MCN_BUF_OF((hub)->pdata)->len : (hub)->obj_size)
+/* Length of topic data passed to publish callbacks */
+#define MCN_DATA_LEN(hub, data) ((hub)->varsize ? MCN_BUF_OF(data)->len : (hub)->obj_size)
+
+struct mcn_buf* mcn_buf_alloc(rt_uint32_t len);
+void mcn_buf_get(struct mcn_buf* buf);
+void mcn_buf_put(struct mcn_buf* buf);
+rt_uint32_t mcn_slab_size(void);
+#else
+#define MCN_HUB_VARSIZE(hub)  0
+#define MCN_HUB_DATA_LEN(hub) ((hub)->obj_size)
+#define MCN_DATA_LEN(hub, data) ((hub)->obj_size)
+#endif
+
+#ifdef UMCN_USING_PERSIST
+rt_err_t mcn_restore(McnHub_t hub, const void* data, rt_uint32_t len);
+void mcn_persist_restore(McnHub_t hub);
+#endif
+
+#ifdef UMCN_USING_RECORDER
+void mcn_recorder_record(McnHub_t hub);
+void mcn_recorder_check(McnHub_t hub, const void* data);
+#endif
+
+#ifdef UMCN_USING_PATTERN
+int mcn_pattern_init(void);
+void mcn_pattern_bind(McnHub_t hub);
+void mcn_pattern_unbind(McnHub_t hub);
+#endif
+
+#ifdef UMCN_USING_GROUP
+void mcn_group_update(McnHub_t hub, McnNode_t node);
+void mcn_group_invoke(McnGroup_t group);
+#endif
+
+#ifdef UMCN_USING_TRACE
+void mcn_trace_forget(McnHub_t hub);
+/* Record a trace event, compiled out if trace is not used */
+#define MCN_TRACE(type, hub)             \
+    do {                                 \
+        if (mcn_trace_enabled)           \
+            mcn_trace_record(type, hub); \
+    } while (0)
+#else
+#define MCN_TRACE(type, hub) ((void)0)
+#endif
+
+#if defined(UMCN_USING_GRAPH) || defined(UMCN_USING_TRACE)
+void mcn_get_owner(char* owner);
+#endif
+
+#ifdef UMCN_USING_GRAPH
+void mcn_graph_publish(McnHub_t hub);
+#endif
+
+#endif
@@ -0,0 +1,435 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <rtthread.h>
+#include <string.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/*
+ * Patterns are indexed by their literal prefix (the part before the first
+ * wildcard) in a first-child/next-sibling trie. When a topic is advertised,
+ * its name is walked down the trie once and only patterns stored on that path
+ * are matched against the rest of the name, so the cost depends on the name
+ * length and the number of candidate patterns, not on the number of topics.
+ *
+ * Binding subscribes topics and allocates memory, so it's serialized by a
+ * mutex instead of the uMCN critical section.
+ */
+struct mcn_trie {
+    char key;
+    struct mcn_trie* child;
+    struct mcn_trie* sibling;
+    /* patterns whose literal prefix ends at this node */
+    McnPattern_t pattern;
+};
+
+struct mcn_binding {
+    McnHub_t hub;
+    McnNode_t node;
+    struct mcn_binding* next;
+};
+
+static struct mcn_trie trie_root;
+static struct rt_mutex pattern_mutex;
+/* number of subscribed patterns, checked without lock on advertise */
+static volatile rt_uint32_t pattern_num;
+
+/**
+ * @brief Length of the literal prefix of pattern
+ */
+static rt_size_t pattern_prefix_len(const char* expr)
+{
+    return strcspn(expr, "*?");
+}
+
+/**
+ * @brief Match a name against glob pattern
+ *
+ * @param expr Pattern, '*' matches any characters and '?' matches one character
+ * @param name Topic name
+ * @return rt_bool_t RT_TRUE if matched
+ */
+static rt_bool_t pattern_match(const char* expr, const char* name)
+{
+    const char* star = RT_NULL;
+    const char* back = RT_NULL;
+
+    while (*name != '\0') {
+        if (*expr == '*') {
+            /* remember where to retry with one more character consumed */
+            star = expr++;
+            back = name;
+        } else if (*expr == '?' || *expr == *name) {
+            expr++;
+            name++;
+        } else if (star != RT_NULL) {
+            expr = star + 1;
+            name = ++back;
+        } else {
+            return RT_FALSE;
+        }
+    }
+
+    while (*expr == '*') {
+        expr++;
+    }
+
+    return *expr == '\0' ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Find child of trie node by key
+ */
+static struct mcn_trie* trie_child(struct mcn_trie* node, char key)
+{
+    struct mcn_trie* child;
+
+    for (child = node->child; child != RT_NULL; child = child->sibling) {
+        if (child->key == key) {
+            break;
+        }
+    }
+
+    return child;
+}
+
+/**
+ * @brief Free empty trie nodes along the prefix path
+ *
+ * @return rt_bool_t RT_TRUE if node itself is empty
+ */
+static rt_bool_t trie_prune(struct mcn_trie* node, const char* prefix, rt_size_t len)
+{
+    if (len > 0) {
+        struct mcn_trie** link = &node->child;
+
+        while (*link != RT_NULL && (*link)->key != *prefix) {
+            link = &(*link)->sibling;
+        }
+
+        if (*link != RT_NULL && trie_prune(*link, prefix + 1, len - 1)) {
+            struct mcn_trie* child = *link;
+
+            *link = child->sibling;
+            MCN_FREE(child);
+        }
+    }
+
+    return node->child == RT_NULL && node->pattern == RT_NULL ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Find the trie node of prefix, create it if not exist
+ */
+static struct mcn_trie* trie_insert(const char* prefix, rt_size_t len)
+{
+    struct mcn_trie* node = &trie_root;
+
+    for (; len > 0; prefix++, len--) {
+        struct mcn_trie* child = trie_child(node, *prefix);
+
+        if (child == RT_NULL) {
+            child = (struct mcn_trie*)MCN_MALLOC(sizeof(struct mcn_trie));
+            if (child == RT_NULL) {
+                return RT_NULL;
+            }
+            child->key = *prefix;
+            child->child = RT_NULL;
+            child->pattern = RT_NULL;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+
+    return node;
+}
+
+/**
+ * @brief Subscribe a topic for pattern
+ * @note Must be called with pattern mutex taken
+ */
+static void pattern_attach(McnPattern_t pattern, McnHub_t hub)
+{
+    struct mcn_binding* binding;
+
+    for (binding = pattern->binding; binding != RT_NULL; binding = binding->next) {
+        if (binding->hub == hub) {
+            /* topic advertised while pattern was subscribing existing ones */
+            return;
+        }
+    }
+
+    binding = (struct mcn_binding*)MCN_MALLOC(sizeof(struct mcn_binding));
+    if (binding == RT_NULL) {
+        return;
+    }
+
+    binding->node = mcn_subscribe(hub, pattern->event, pattern->pub_cb);
+    if (binding->node == RT_NULL) {
+        MCN_FREE(binding);
+        return;
+    }
+    binding->hub = hub;
+    binding->next = pattern->binding;
+    pattern->binding = binding;
+    pattern->bind_num++;
+
+    if (pattern->bind != RT_NULL) {
+        pattern->bind(pattern, hub, binding->node);
+    }
+}
+
+/**
+ * @brief Subscribe a newly advertised topic for all matching patterns
+ *
+ * @param hub uMCN hub
+ */
+void mcn_pattern_bind(McnHub_t hub)
+{
+    struct mcn_trie* node = &trie_root;
+    const char* name = hub->obj_name;
+
+    if (pattern_num == 0) {
+        return;
+    }
+
+    rt_mutex_take(&pattern_mutex, RT_WAITING_FOREVER);
+
+    while (node != RT_NULL) {
+        McnPattern_t pattern;
+
+        for (pattern = node->pattern; pattern != RT_NULL; pattern = pattern->next) {
+            /* prefix is matched by the trie path */
+            if (pattern_match(pattern->expr + pattern_prefix_len(pattern->expr), name)) {
+                pattern_attach(pattern, hub);
+            }
+        }
+
+        if (*name == '\0') {
+            break;
+        }
+        node = trie_child(node, *name++);
+    }
+
+    rt_mutex_release(&pattern_mutex);
+}
+
+/**
+ * @brief Unsubscribe a topic for pattern
+ * @note Must be called with pattern mutex taken
+ */
+static void pattern_detach(McnPattern_t pattern, McnHub_t hub)
+{
+    struct mcn_binding** link;
+
+    for (link = &pattern->binding; *link != RT_NULL; link = &(*link)->next) {
+        struct mcn_binding* binding = *link;
+
+        if (binding->hub == hub) {
+            *link = binding->next;
+            pattern->bind_num--;
+
+            if (pattern->bind != RT_NULL) {
+                /* RT_NULL node tells the topic is gone */
+                pattern->bind(pattern, hub, RT_NULL);
+            }
+
+            mcn_unsubscribe(hub, binding->node);
+            MCN_FREE(binding);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Unsubscribe a destroyed topic for all matching patterns
+ * @note Binding holds a reference of the topic, it would never be freed otherwise
+ *
+ * @param hub uMCN hub
+ */
+void mcn_pattern_unbind(McnHub_t hub)
+{
+    struct mcn_trie* node = &trie_root;
+    const char* name = hub->obj_name;
+
+    if (pattern_num == 0) {
+        return;
+    }
+
+    rt_mutex_take(&pattern_mutex, RT_WAITING_FOREVER);
+
+    while (node != RT_NULL) {
+        McnPattern_t pattern;
+
+        for (pattern = node->pattern; pattern != RT_NULL; pattern = pattern->next) {
+            if (pattern_match(pattern->expr + pattern_prefix_len(pattern->expr), name)) {
+                pattern_detach(pattern, hub);
+            }
+        }
+
+        if (*name == '\0') {
+            break;
+        }
+        node = trie_child(node, *name++);
+    }
+
+    rt_mutex_release(&pattern_mutex);
+}
+
+/**
+ * @brief Subscribe all topics whose name matches a pattern
+ * @note Matching topics advertised later are subscribed as well. The pattern
+ * object and expression must be kept until unsubscribed. bind is called for
+ * each subscribed topic with the pattern mutex taken, so it should not call
+ * pattern functions. When a bound topic is destroyed, it's unsubscribed and
+ * bind is called with RT_NULL node
+ *
+ * @param pattern Pattern object
+ * @param expr Name pattern, e.g, "sensor_*". '*' matches any characters and '?' matches one character
+ * @param event Event handler shared by all subscribed topics, can be RT_NULL
+ * @param pub_cb Topic published callback function, can be RT_NULL
+ * @param bind Callback when a topic is subscribed or destroyed, can be RT_NULL
+ * @param parameter User parameter
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_pattern_subscribe(McnPattern_t pattern, const char* expr, MCN_EVENT_HANDLE event,
+    void (*pub_cb)(void* parameter), void (*bind)(McnPattern_t pattern, McnHub_t hub, McnNode_t node),
+    void* parameter)
+{
+    struct mcn_trie* node;
+    McnList_t ite = mcn_get_list();
+    rt_size_t len;
+
+    MCN_ASSERT(pattern != RT_NULL);
+    MCN_ASSERT(expr != RT_NULL);
+
+    pattern->expr = expr;
+    pattern->event = event;
+    pattern->pub_cb = pub_cb;
+    pattern->bind = bind;
+    pattern->parameter = parameter;
+    pattern->binding = RT_NULL;
+    pattern->bind_num = 0;
+
+    len = pattern_prefix_len(expr);
+
+    rt_mutex_take(&pattern_mutex, RT_WAITING_FOREVER);
+
+    node = trie_insert(expr, len);
+    if (node == RT_NULL) {
+        trie_prune(&trie_root, expr, len);
+        rt_mutex_release(&pattern_mutex);
+        return -RT_ENOMEM;
+    }
+    pattern->next = node->pattern;
+    node->pattern = pattern;
+    pattern_num++;
+
+    /* topics advertised from now on are bound by mcn_pattern_bind() */
+    for (McnHub_t hub = mcn_iterate(&ite); hub != RT_NULL; hub = mcn_iterate(&ite)) {
+        if (pattern_match(expr, hub->obj_name)) {
+            pattern_attach(pattern, hub);
+        }
+    }
+
+    rt_mutex_release(&pattern_mutex);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Unsubscribe all topics of a pattern
+ *
+ * @param pattern Pattern object
+ */
+void mcn_pattern_unsubscribe(McnPattern_t pattern)
+{
+    struct mcn_trie* node;
+    McnPattern_t* link;
+    rt_size_t len;
+
+    MCN_ASSERT(pattern != RT_NULL);
+
+    len = pattern_prefix_len(pattern->expr);
+
+    rt_mutex_take(&pattern_mutex, RT_WAITING_FOREVER);
+
+    node = &trie_root;
+    for (rt_size_t i = 0; i < len && node != RT_NULL; i++) {
+        node = trie_child(node, pattern->expr[i]);
+    }
+
+    if (node != RT_NULL) {
+        for (link = &node->pattern; *link != RT_NULL; link = &(*link)->next) {
+            if (*link == pattern) {
+                *link = pattern->next;
+                pattern_num--;
+                trie_prune(&trie_root, pattern->expr, len);
+                break;
+            }
+        }
+    }
+
+    while (pattern->binding != RT_NULL) {
+        struct mcn_binding* binding = pattern->binding;
+
+        pattern->binding = binding->next;
+        mcn_unsubscribe(binding->hub, binding->node);
+        MCN_FREE(binding);
+    }
+    pattern->bind_num = 0;
+
+    rt_mutex_release(&pattern_mutex);
+}
+
+/**
+ * @brief Get the subscribe node of a topic bound to pattern
+ *
+ * @param pattern Pattern object
+ * @param hub uMCN hub
+ * @return McnNode_t Subscribe node, RT_NULL if topic is not bound
+ */
+McnNode_t mcn_pattern_node(McnPattern_t pattern, McnHub_t hub)
+{
+    struct mcn_binding* binding;
+    McnNode_t node = RT_NULL;
+
+    MCN_ASSERT(pattern != RT_NULL);
+
+    rt_mutex_take(&pattern_mutex, RT_WAITING_FOREVER);
+    for (binding = pattern->binding; binding != RT_NULL; binding = binding->next) {
+        if (binding->hub == hub) {
+            node = binding->node;
+            break;
+        }
+    }
+    rt_mutex_release(&pattern_mutex);
+
+    return node;
+}
+
+/**
+ * @brief Initialize pattern subscription
+ *
+ * @return int RT_EOK indicates success
+ */
+int mcn_pattern_init(void)
+{
+    return rt_mutex_init(&pattern_mutex, "mcn_pat", RT_IPC_FLAG_PRIO);
+}
@@ -0,0 +1,454 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+#ifdef RT_USING_DFS
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Snapshot layout, in native byte order:
+ *
+ *   header | record | record | ...
+ *   record: name length (1 byte) | name | data length (4 bytes) | data
+ *
+ * The checksum in header covers all records, so a torn write is detected and
+ * the whole snapshot is ignored.
+ */
+#define SNAPSHOT_MAGIC   0x504E434D /* "MCNP" */
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_header {
+    rt_uint32_t magic;
+    rt_uint16_t version;
+    rt_uint16_t count;
+    /* size of records */
+    rt_uint32_t size;
+    rt_uint32_t checksum;
+};
+
+struct persist_entry {
+    McnHub_t hub;
+    struct persist_entry* next;
+};
+
+static const McnPersistOps* persist_ops;
+static void* persist_ctx;
+static rt_uint32_t persist_period;
+static struct rt_mutex persist_mutex;
+static struct persist_entry* persist_list;
+/* records loaded at init, freed once all of them are restored */
+static rt_uint8_t* restore_image;
+static rt_uint32_t restore_size;
+static rt_uint16_t restore_left;
+/* snapshot buffer, kept for the next save */
+static rt_uint8_t* save_buf;
+static rt_uint32_t save_size;
+/* last write failed, retry even if nothing changed */
+static rt_bool_t save_pending;
+
+/**
+ * @brief FNV-1a checksum of snapshot records
+ */
+static rt_uint32_t snapshot_checksum(const rt_uint8_t* data, rt_uint32_t size)
+{
+    rt_uint32_t hash = 2166136261UL;
+
+    while (size--) {
+        hash ^= *data++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Load snapshot from backend
+ */
+static void snapshot_load(void)
+{
+    struct snapshot_header header;
+
+    if (persist_ops->read(persist_ctx, 0, &header, sizeof(header)) != sizeof(header)) {
+        /* no snapshot yet */
+        return;
+    }
+
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.count == 0) {
+        return;
+    }
+
+    restore_image = (rt_uint8_t*)MCN_MALLOC(header.size);
+    if (restore_image == RT_NULL) {
+        return;
+    }
+
+    if (persist_ops->read(persist_ctx, sizeof(header), restore_image, header.size) != (rt_int32_t)header.size
+        || snapshot_checksum(restore_image, header.size) != header.checksum) {
+        /* corrupted snapshot */
+        MCN_FREE(restore_image);
+        restore_image = RT_NULL;
+        return;
+    }
+
+    restore_size = header.size;
+    restore_left = header.count;
+}
+
+/**
+ * @brief Restore topic from loaded snapshot
+ * @note Must be called with persist mutex taken
+ */
+static void snapshot_restore(McnHub_t hub)
+{
+    rt_uint32_t pos = 0;
+
+    if (restore_image == RT_NULL) {
+        return;
+    }
+
+    while (pos < restore_size) {
+        rt_uint8_t name_len = restore_image[pos];
+        const char* name = (const char*)&restore_image[pos + 1];
+        rt_uint32_t len;
+
+        if (pos + 1 + name_len + sizeof(len) > restore_size) {
+            break;
+        }
+        rt_memcpy(&len, &restore_image[pos + 1 + name_len], sizeof(len));
+        if (len > restore_size - (pos + 1 + name_len + sizeof(len))) {
+            break;
+        }
+
+        if (name_len == strlen(hub->obj_name) && strncmp(name, hub->obj_name, name_len) == 0) {
+            /* layout is checked by size only, a changed topic is not restored */
+            if (len == hub->obj_size || (MCN_HUB_VARSIZE(hub) && len < hub->obj_size)) {
+                mcn_restore(hub, &restore_image[pos + 1 + name_len + sizeof(len)], len);
+            }
+
+            if (--restore_left == 0) {
+                MCN_FREE(restore_image);
+                restore_image = RT_NULL;
+            }
+            break;
+        }
+
+        pos += 1 + name_len + sizeof(len) + len;
+    }
+}
+
+/**
+ * @brief Restore persistent topic when it's advertised
+ *
+ * @param hub uMCN hub
+ */
+void mcn_persist_restore(McnHub_t hub)
+{
+    rt_mutex_take(&persist_mutex, RT_WAITING_FOREVER);
+    snapshot_restore(hub);
+    rt_mutex_release(&persist_mutex);
+}
+
+/**
+ * @brief Write snapshot of persistent topics to backend
+ * @note Nothing is written if no persistent topic has been published since last
+ * snapshot. It's called periodically by background thread, and can be called
+ * directly, e.g, before a planned reboot
+ *
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_persist_save(void)
+{
+    struct snapshot_header header;
+    struct persist_entry* entry;
+    rt_bool_t dirty = save_pending;
+    rt_uint32_t size = 0;
+    rt_uint32_t pos;
+    rt_err_t err;
+    rt_base_t level;
+
+    if (persist_ops == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+    rt_mutex_take(&persist_mutex, RT_WAITING_FOREVER);
+
+    for (entry = persist_list; entry != RT_NULL; entry = entry->next) {
+        dirty |= entry->hub->persist_dirty;
+        size += 1 + strlen(entry->hub->obj_name) + sizeof(rt_uint32_t) + entry->hub->obj_size;
+    }
+
+    if (!dirty) {
+        rt_mutex_release(&persist_mutex);
+        return RT_EOK;
+    }
+
+    size += sizeof(header);
+    if (size > save_size) {
+        MCN_FREE(save_buf);
+        save_buf = (rt_uint8_t*)MCN_MALLOC(size);
+        save_size = save_buf != RT_NULL ? size : 0;
+        if (save_buf == RT_NULL) {
+            rt_mutex_release(&persist_mutex);
+            return -RT_ENOMEM;
+        }
+    }
+
+    header.count = 0;
+    pos = sizeof(header);
+    for (entry = persist_list; entry != RT_NULL; entry = entry->next) {
+        McnHub_t hub = entry->hub;
+        rt_size_t name_len = strlen(hub->obj_name);
+        rt_uint32_t len;
+
+        if (!hub->published || name_len > 0xFF) {
+            continue;
+        }
+
+        save_buf[pos] = (rt_uint8_t)name_len;
+        rt_memcpy(&save_buf[pos + 1], hub->obj_name, name_len);
+        pos += 1 + name_len;
+
+        MCN_HUB_LOCK(hub, level);
+        len = MCN_HUB_DATA_LEN(hub);
+        mcn_memcpy(&save_buf[pos + sizeof(len)], hub->pdata, len);
+        hub->persist_dirty = 0;
+        MCN_HUB_UNLOCK(hub, level);
+
+        rt_memcpy(&save_buf[pos], &len, sizeof(len));
+        pos += sizeof(len) + len;
+        header.count++;
+    }
+
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.size = pos - sizeof(header);
+    header.checksum = snapshot_checksum(&save_buf[sizeof(header)], header.size);
+    rt_memcpy(save_buf, &header, sizeof(header));
+
+    err = persist_ops->write(persist_ctx, save_buf, pos);
+    save_pending = err != RT_EOK;
+
+    rt_mutex_release(&persist_mutex);
+
+    return err;
+}
+
+/**
+ * @brief Background snapshot thread entry
+ */
+static void persist_thread_entry(void* parameter)
+{
+    while (1) {
+        rt_thread_mdelay(persist_period);
+        mcn_persist_save();
+    }
+}
+
+/**
+ * @brief Initialize topic persistence
+ * @note The stored snapshot is loaded here, so it should be called before
+ * persistent topics are advertised
+ *
+ * @param ops Storage backend
+ * @param ctx Backend context, e.g, file path
+ * @param period_ms Interval to write snapshot in background, 0 to only save by mcn_persist_save()
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_persist_init(const McnPersistOps* ops, void* ctx, rt_uint32_t period_ms)
+{
+    MCN_ASSERT(ops != RT_NULL);
+    MCN_ASSERT(ops->read != RT_NULL && ops->write != RT_NULL);
+
+    if (persist_ops != RT_NULL) {
+        /* already initialized */
+        return -RT_EBUSY;
+    }
+
+    if (rt_mutex_init(&persist_mutex, "mcn_pst", RT_IPC_FLAG_PRIO) != RT_EOK) {
+        return -RT_ERROR;
+    }
+
+    persist_ctx = ctx;
+    persist_period = period_ms;
+    persist_ops = ops;
+
+    snapshot_load();
+
+    if (period_ms > 0) {
+        rt_thread_t tid = rt_thread_create("mcn_pst", persist_thread_entry, RT_NULL,
+            MCN_PERSIST_STACK_SIZE, MCN_PERSIST_PRIORITY, 10);
+
+        if (tid == RT_NULL) {
+            return -RT_ENOMEM;
+        }
+        rt_thread_startup(tid);
+    }
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Make topic persistent
+ * @note The last value is restored when the topic is advertised, or at once if
+ * it's already advertised but not published yet. Topic created by mcn_create()
+ * is kept alive from now on
+ *
+ * @param hub uMCN hub
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_persist_enable(McnHub_t hub)
+{
+    struct persist_entry* entry;
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (persist_ops == RT_NULL) {
+        /* mcn_persist_init() is not called */
+        return -RT_ERROR;
+    }
+
+    entry = (struct persist_entry*)MCN_MALLOC(sizeof(struct persist_entry));
+    if (entry == RT_NULL) {
+        return -RT_ENOMEM;
+    }
+    entry->hub = hub;
+
+    rt_mutex_take(&persist_mutex, RT_WAITING_FOREVER);
+
+    if (hub->persist || mcn_hub_get(hub) != RT_EOK) {
+        rt_mutex_release(&persist_mutex);
+        MCN_FREE(entry);
+        return -RT_ERROR;
+    }
+
+    entry->next = persist_list;
+    persist_list = entry;
+    hub->persist = 1;
+
+    if (hub->pdata != RT_NULL && !hub->published) {
+        snapshot_restore(hub);
+    }
+
+    rt_mutex_release(&persist_mutex);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Check if topic data is restored from snapshot and not published yet
+ *
+ * @param hub uMCN hub
+ * @return rt_bool_t RT_TRUE if data is stale
+ */
+rt_bool_t mcn_is_stale(McnHub_t hub)
+{
+    MCN_ASSERT(hub != RT_NULL);
+
+    return hub->stale ? RT_TRUE : RT_FALSE;
+}
+
+#ifdef RT_USING_DFS
+/**
+ * @brief Get path of the temporary snapshot file
+ * @note Returned path should be freed by MCN_FREE()
+ */
+static char* file_tmp_path(const char* path)
+{
+    rt_size_t path_len = strlen(path);
+    char* tmp_path = (char*)MCN_MALLOC(path_len + 5);
+
+    if (tmp_path != RT_NULL) {
+        rt_memcpy(tmp_path, path, path_len);
+        rt_memcpy(tmp_path + path_len, ".tmp", 5);
+    }
+
+    return tmp_path;
+}
+
+static rt_int32_t file_read(void* ctx, rt_uint32_t offset, void* buf, rt_uint32_t len)
+{
+    int fd = open((const char*)ctx, O_RDONLY);
+    int res = -1;
+
+    if (fd < 0) {
+        /* interrupted between removing the old snapshot and renaming the new one */
+        char* tmp_path = file_tmp_path((const char*)ctx);
+
+        if (tmp_path == RT_NULL) {
+            return -RT_ENOMEM;
+        }
+        fd = open(tmp_path, O_RDONLY);
+        MCN_FREE(tmp_path);
+
+        if (fd < 0) {
+            return -RT_ERROR;
+        }
+    }
+
+    if (lseek(fd, offset, SEEK_SET) == (off_t)offset) {
+        res = read(fd, buf, len);
+    }
+    close(fd);
+
+    return res < 0 ? -RT_ERROR : res;
+}
+
+static rt_err_t file_write(void* ctx, const void* buf, rt_uint32_t len)
+{
+    const char* path = (const char*)ctx;
+    char* tmp_path;
+    int fd;
+    rt_err_t err = -RT_ERROR;
+
+    tmp_path = file_tmp_path(path);
+    if (tmp_path == RT_NULL) {
+        return -RT_ENOMEM;
+    }
+
+    /* write a new file, so the old snapshot stays intact if interrupted */
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd >= 0) {
+        rt_bool_t ok = write(fd, buf, len) == (int)len && fsync(fd) == 0;
+
+        close(fd);
+        if (ok) {
+            err = rename(tmp_path, path) == 0 ? RT_EOK : -RT_ERROR;
+            if (err != RT_EOK) {
+                /* file systems like FAT don't rename over an existing file, the
+                 * complete temporary file is read instead until renamed */
+                unlink(path);
+                err = rename(tmp_path, path) == 0 ? RT_EOK : -RT_ERROR;
+            }
+        }
+    }
+    MCN_FREE(tmp_path);
+
+    return err;
+}
+
+const McnPersistOps mcn_persist_file_ops = {
+    .read = file_read,
+    .write = file_write,
+};
+#endif
@@ -0,0 +1,377 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/*
+ * Flight recorder keeps the latest samples of selected topics in a fixed ring.
+ *
+ * Publishers reserve space by an atomic add on a free running write position,
+ * so no lock is shared between topics. Each record starts with a header
+ * holding its own position, written last. As the ring wraps, a stale or
+ * half overwritten record can't carry the expected position, so the dump
+ * finds the oldest complete record by scanning for a header whose position
+ * matches where it's stored.
+ *
+ * Binary log layout, in native byte order:
+ *
+ *   log header | topic | topic | ... | record | record | ...
+ *   topic: id (2 bytes) | size (4 bytes) | name length (1 byte) | name
+ *   record: record header | data
+ */
+#define REC_MASK       (MCN_RECORDER_SIZE - 1)
+#define REC_ALIGN      8
+#define REC_MAGIC      0x524E434D /* "MCNR" */
+#define REC_VERSION    1
+#define REC_CHUNK_SIZE 64
+
+/*
+ * Freezing is a handshake between publishers (count rec_writers, then check
+ * rec_frozen) and the dump (set rec_frozen, then check rec_writers), which
+ * needs sequentially consistent ordering on SMP.
+ */
+#ifdef RT_USING_SMP
+#define REC_LOAD(ptr)           __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define REC_STORE(ptr, val)     __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+#define REC_FETCH_ADD(ptr, val) __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST)
+#define REC_EXCHANGE(ptr, val)  __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST)
+#else
+/* cores without atomic instructions, accesses are protected by disabling interrupts */
+#define REC_LOAD(ptr)           rec_load(ptr)
+#define REC_STORE(ptr, val)     rec_exchange(ptr, val)
+#define REC_FETCH_ADD(ptr, val) rec_fetch_add(ptr, val)
+#define REC_EXCHANGE(ptr, val)  rec_exchange(ptr, val)
+
+rt_inline rt_uint32_t rec_load(rt_uint32_t* ptr)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_uint32_t val = *ptr;
+
+    rt_hw_interrupt_enable(level);
+
+    return val;
+}
+
+rt_inline rt_uint32_t rec_fetch_add(rt_uint32_t* ptr, rt_uint32_t val)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_uint32_t old = *ptr;
+
+    *ptr = old + val;
+    rt_hw_interrupt_enable(level);
+
+    return old;
+}
+
+rt_inline rt_uint32_t rec_exchange(rt_uint32_t* ptr, rt_uint32_t val)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+    rt_uint32_t old = *ptr;
+
+    *ptr = val;
+    rt_hw_interrupt_enable(level);
+
+    return old;
+}
+#endif
+
+struct rec_header {
+    /* position of record in ring since start, identifies a valid header */
+    rt_uint32_t pos;
+    rt_uint16_t id;
+    rt_uint16_t len;
+    rt_uint64_t timestamp;
+};
+
+struct rec_log_header {
+    rt_uint32_t magic;
+    rt_uint16_t version;
+    rt_uint16_t topic_num;
+    rt_uint64_t trigger_time;
+};
+
+typedef char rec_size_check[(MCN_RECORDER_SIZE & REC_MASK) == 0 ? 1 : -1];
+
+static rt_uint64_t rec_ring[MCN_RECORDER_SIZE / sizeof(rt_uint64_t)];
+/* free running write position, positions are compared by difference so it can wrap */
+static rt_uint32_t rec_head;
+/* ring has been written around */
+static rt_uint32_t rec_filled;
+/* publishers writing into ring, or trigger setting the trigger time */
+static rt_uint32_t rec_writers;
+static rt_uint32_t rec_frozen;
+static rt_uint64_t rec_trigger_time;
+static McnHub_t rec_topic[MCN_RECORDER_MAX_TOPIC];
+static rt_bool_t (*rec_cond[MCN_RECORDER_MAX_TOPIC])(const void* data, rt_uint32_t len);
+static rt_uint16_t rec_topic_num;
+
+/**
+ * @brief Copy data into ring, wrapping at the end
+ */
+static void ring_write(rt_uint32_t pos, const void* data, rt_uint32_t len)
+{
+    rt_uint32_t offset = pos & REC_MASK;
+    rt_uint32_t first = len < MCN_RECORDER_SIZE - offset ? len : MCN_RECORDER_SIZE - offset;
+
+    rt_memcpy((rt_uint8_t*)rec_ring + offset, data, first);
+    if (len > first) {
+        rt_memcpy(rec_ring, (const rt_uint8_t*)data + first, len - first);
+    }
+}
+
+/**
+ * @brief Copy data out of ring, wrapping at the end
+ */
+static void ring_read(rt_uint32_t pos, void* data, rt_uint32_t len)
+{
+    rt_uint32_t offset = pos & REC_MASK;
+    rt_uint32_t first = len < MCN_RECORDER_SIZE - offset ? len : MCN_RECORDER_SIZE - offset;
+
+    rt_memcpy(data, (const rt_uint8_t*)rec_ring + offset, first);
+    if (len > first) {
+        rt_memcpy((rt_uint8_t*)data + first, rec_ring, len - first);
+    }
+}
+
+/**
+ * @brief Ring space used by a record
+ */
+static rt_uint32_t record_size(rt_uint32_t len)
+{
+    return RT_ALIGN(sizeof(struct rec_header) + len, REC_ALIGN);
+}
+
+/**
+ * @brief Record the published sample of topic
+ * @note Called by publisher with hub locked
+ *
+ * @param hub uMCN hub
+ */
+void mcn_recorder_record(McnHub_t hub)
+{
+    rt_uint8_t index = hub->rec_id - 1;
+    rt_uint32_t len = MCN_HUB_DATA_LEN(hub);
+    struct rec_header header;
+
+    if (len > 0xFFFF || record_size(len) > MCN_RECORDER_SIZE / 4) {
+        /* too large to keep a useful window */
+        return;
+    }
+
+    REC_FETCH_ADD(&rec_writers, 1);
+
+    if (!REC_LOAD(&rec_frozen)) {
+        header.pos = REC_FETCH_ADD(&rec_head, record_size(len));
+        if (!REC_LOAD(&rec_filled) && header.pos + record_size(len) >= MCN_RECORDER_SIZE) {
+            REC_STORE(&rec_filled, 1);
+        }
+        header.id = index;
+        header.len = (rt_uint16_t)len;
+#ifdef MCN_HUB_TIMESTAMP
+        header.timestamp = hub->timestamp;
+#else
+        header.timestamp = MCN_TIMESTAMP_US();
+#endif
+
+        ring_write(header.pos + sizeof(header), hub->pdata, len);
+        ring_write(header.pos + sizeof(header.pos), (rt_uint8_t*)&header + sizeof(header.pos),
+            sizeof(header) - sizeof(header.pos));
+        /* publish the record, position is aligned and never wraps */
+        REC_STORE((rt_uint32_t*)((rt_uint8_t*)rec_ring + (header.pos & REC_MASK)), header.pos);
+    }
+
+    REC_FETCH_ADD(&rec_writers, (rt_uint32_t)-1);
+}
+
+/**
+ * @brief Check trigger condition of recorded topic
+ * @note Called by publisher after the hub is unlocked
+ *
+ * @param hub uMCN hub
+ * @param data Published topic data
+ */
+void mcn_recorder_check(McnHub_t hub, const void* data)
+{
+    rt_bool_t (*cond)(const void* data, rt_uint32_t len) = rec_cond[hub->rec_id - 1];
+
+    if (cond != RT_NULL && cond(data, MCN_DATA_LEN(hub, data))) {
+        mcn_recorder_trigger();
+    }
+}
+
+/**
+ * @brief Record samples of a topic in flight recorder
+ * @note Topics should be added at initialization. Topic created by mcn_create()
+ * is kept alive from now on
+ *
+ * @param hub uMCN hub
+ * @param trigger Condition to trigger the recorder, can be RT_NULL. It's called by
+ * publisher like a publish callback, so it should be quick
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_recorder_add(McnHub_t hub, rt_bool_t (*trigger)(const void* data, rt_uint32_t len))
+{
+    rt_err_t err = RT_EOK;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (mcn_hub_get(hub) != RT_EOK) {
+        return -RT_ERROR;
+    }
+
+    MCN_LOCK(level);
+    if (hub->rec_id) {
+        err = -RT_EBUSY;
+    } else if (rec_topic_num >= MCN_RECORDER_MAX_TOPIC) {
+        err = -RT_EFULL;
+    } else {
+        rec_topic[rec_topic_num] = hub;
+        rec_cond[rec_topic_num] = trigger;
+        rec_topic_num++;
+        /* start recording */
+        hub->rec_id = rec_topic_num;
+    }
+    MCN_UNLOCK(level);
+
+    if (err != RT_EOK) {
+        mcn_release(hub);
+    }
+
+    return err;
+}
+
+/**
+ * @brief Freeze the flight recorder
+ * @note Samples before the trigger are kept until mcn_recorder_resume()
+ */
+void mcn_recorder_trigger(void)
+{
+    rt_uint64_t now = MCN_TIMESTAMP_US();
+
+    /* dump waits until the first trigger has set the time */
+    REC_FETCH_ADD(&rec_writers, 1);
+    if (REC_EXCHANGE(&rec_frozen, 1) == 0) {
+        rec_trigger_time = now;
+    }
+    REC_FETCH_ADD(&rec_writers, (rt_uint32_t)-1);
+}
+
+/**
+ * @brief Check if flight recorder is triggered
+ *
+ * @return rt_bool_t RT_TRUE if triggered
+ */
+rt_bool_t mcn_recorder_triggered(void)
+{
+    return REC_LOAD(&rec_frozen) ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Clear flight recorder and start recording again
+ */
+void mcn_recorder_resume(void)
+{
+    while (REC_LOAD(&rec_writers)) {
+        /* let a lower priority publisher finish */
+        rt_thread_delay(1);
+    }
+    REC_STORE(&rec_head, 0);
+    REC_STORE(&rec_filled, 0);
+    rt_memset(rec_ring, 0, sizeof(rec_ring));
+    REC_STORE(&rec_frozen, 0);
+}
+
+/**
+ * @brief Dump the flight recorder as binary log
+ * @note The recorder is triggered if it's not yet
+ *
+ * @param output Output function
+ * @param ctx Output context
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_recorder_dump(McnOutput_t output, void* ctx)
+{
+    struct rec_log_header log_header;
+    struct rec_header header;
+    rt_uint8_t chunk[REC_CHUNK_SIZE];
+    rt_uint32_t head, pos;
+    rt_uint16_t i;
+
+    MCN_ASSERT(output != RT_NULL);
+
+    mcn_recorder_trigger();
+    /* wait publishers who reserved space before freezing */
+    while (REC_LOAD(&rec_writers)) {
+        /* let a lower priority publisher finish */
+        rt_thread_delay(1);
+    }
+
+    log_header.magic = REC_MAGIC;
+    log_header.version = REC_VERSION;
+    log_header.topic_num = rec_topic_num;
+    log_header.trigger_time = rec_trigger_time;
+    output(ctx, &log_header, sizeof(log_header));
+
+    for (i = 0; i < rec_topic_num; i++) {
+        McnHub_t hub = rec_topic[i];
+        rt_uint32_t size = hub->obj_size;
+        rt_size_t len = strlen(hub->obj_name);
+        rt_uint8_t name_len = len > 0xFF ? 0xFF : (rt_uint8_t)len;
+
+        output(ctx, &i, sizeof(i));
+        output(ctx, &size, sizeof(size));
+        output(ctx, &name_len, sizeof(name_len));
+        output(ctx, hub->obj_name, name_len);
+    }
+
+    head = REC_LOAD(&rec_head);
+    pos = head - (REC_LOAD(&rec_filled) ? MCN_RECORDER_SIZE : head);
+
+    /* find the oldest record not overwritten */
+    for (; pos != head; pos += REC_ALIGN) {
+        ring_read(pos, &header, sizeof(header));
+        if (header.pos == pos && header.id < rec_topic_num && record_size(header.len) <= head - pos) {
+            break;
+        }
+    }
+
+    while (pos != head) {
+        rt_uint32_t len;
+        rt_uint32_t offset;
+
+        ring_read(pos, &header, sizeof(header));
+        if (header.pos != pos || header.id >= rec_topic_num || record_size(header.len) > head - pos) {
+            /* not completely written */
+            break;
+        }
+        output(ctx, &header, sizeof(header));
+
+        for (offset = 0; offset < header.len; offset += len) {
+            len = header.len - offset < REC_CHUNK_SIZE ? header.len - offset : REC_CHUNK_SIZE;
+            ring_read(pos + sizeof(header) + offset, chunk, len);
+            output(ctx, chunk, len);
+        }
+
+        pos += record_size(header.len);
+    }
+
+    return RT_EOK;
+}
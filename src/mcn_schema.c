@@ -0,0 +1,285 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+static const rt_uint8_t type_size[] = {
+    [MCN_TYPE_INT8] = 1,
+    [MCN_TYPE_UINT8] = 1,
+    [MCN_TYPE_INT16] = 2,
+    [MCN_TYPE_UINT16] = 2,
+    [MCN_TYPE_INT32] = 4,
+    [MCN_TYPE_UINT32] = 4,
+    [MCN_TYPE_INT64] = 8,
+    [MCN_TYPE_UINT64] = 8,
+    [MCN_TYPE_FLOAT] = 4,
+    [MCN_TYPE_DOUBLE] = 8,
+    [MCN_TYPE_BOOL] = 1,
+    [MCN_TYPE_CHAR] = 1,
+};
+
+rt_inline rt_uint32_t field_size(const McnField* field)
+{
+    return (rt_uint32_t)type_size[field->type] * field->count;
+}
+
+/**
+ * @brief Print one element of field into text buffer
+ *
+ * @return int Length printed (may exceed size if truncated)
+ */
+static int format_element(char* buffer, rt_uint32_t size, rt_uint8_t type, const void* elem)
+{
+    /* elements may be unaligned inside packed structures */
+    union {
+        rt_int8_t i8;
+        rt_uint8_t u8;
+        rt_int16_t i16;
+        rt_uint16_t u16;
+        rt_int32_t i32;
+        rt_uint32_t u32;
+        rt_int64_t i64;
+        rt_uint64_t u64;
+        float f;
+        double d;
+    } v;
+
+    rt_memcpy(&v, elem, type_size[type]);
+
+    switch (type) {
+    case MCN_TYPE_INT8:
+        return snprintf(buffer, size, "%d", v.i8);
+    case MCN_TYPE_UINT8:
+        return snprintf(buffer, size, "%u", v.u8);
+    case MCN_TYPE_INT16:
+        return snprintf(buffer, size, "%d", v.i16);
+    case MCN_TYPE_UINT16:
+        return snprintf(buffer, size, "%u", v.u16);
+    case MCN_TYPE_INT32:
+        return snprintf(buffer, size, "%ld", (long)v.i32);
+    case MCN_TYPE_UINT32:
+        return snprintf(buffer, size, "%lu", (unsigned long)v.u32);
+    case MCN_TYPE_INT64:
+        return snprintf(buffer, size, "%lld", (long long)v.i64);
+    case MCN_TYPE_UINT64:
+        return snprintf(buffer, size, "%llu", (unsigned long long)v.u64);
+    case MCN_TYPE_FLOAT:
+        return snprintf(buffer, size, "%f", v.f);
+    case MCN_TYPE_DOUBLE:
+        return snprintf(buffer, size, "%f", v.d);
+    case MCN_TYPE_BOOL:
+        return snprintf(buffer, size, "%s", v.u8 ? "true" : "false");
+    default:
+        return snprintf(buffer, size, "?");
+    }
+}
+
+/**
+ * @brief Attach schema to a uMCN topic
+ * @note The schema is not copied, it must stay valid as long as the hub
+ *
+ * @param hub uMCN hub
+ * @param schema Topic schema, which can be defined by MCN_SCHEMA() macro
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_set_schema(McnHub_t hub, const McnSchema* schema)
+{
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(schema != RT_NULL);
+
+    for (rt_uint16_t i = 0; i < schema->field_num; i++) {
+        const McnField* field = &schema->fields[i];
+
+        if (field->type > MCN_TYPE_CHAR || field->count == 0) {
+            return -RT_EINVAL;
+        }
+        if (field->offset + field_size(field) > hub->obj_size) {
+            /* field out of topic range */
+            return -RT_EINVAL;
+        }
+    }
+
+    hub->schema = schema;
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Get serialized size of topic data
+ *
+ * @param hub uMCN hub
+ * @return rt_uint32_t Serialized size, 0 if no schema attached
+ */
+rt_uint32_t mcn_serialized_size(McnHub_t hub)
+{
+    const McnSchema* schema = hub->schema;
+    rt_uint32_t size = 0;
+
+    if (schema == RT_NULL) {
+        return 0;
+    }
+
+    for (rt_uint16_t i = 0; i < schema->field_num; i++) {
+        size += field_size(&schema->fields[i]);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Serialize topic data into compact binary
+ * @note Fields are packed in schema order without padding, in native byte order
+ *
+ * @param hub uMCN hub
+ * @param data Topic data
+ * @param buffer Output buffer
+ * @param size Output buffer size
+ * @return rt_int32_t Serialized length, negative value indicates error
+ */
+rt_int32_t mcn_serialize(McnHub_t hub, const void* data, void* buffer, rt_uint32_t size)
+{
+    const McnSchema* schema;
+    rt_uint8_t* out = (rt_uint8_t*)buffer;
+    rt_uint32_t len = 0;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(data != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    schema = hub->schema;
+    if (schema == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+    for (rt_uint16_t i = 0; i < schema->field_num; i++) {
+        const McnField* field = &schema->fields[i];
+        rt_uint32_t fsize = field_size(field);
+
+        if (len + fsize > size) {
+            return -RT_EFULL;
+        }
+        rt_memcpy(&out[len], (const rt_uint8_t*)data + field->offset, fsize);
+        len += fsize;
+    }
+
+    return len;
+}
+
+/**
+ * @brief Deserialize compact binary into topic data
+ * @note Bytes not described by schema in data are left unchanged
+ *
+ * @param hub uMCN hub
+ * @param buffer Serialized data
+ * @param len Serialized data length
+ * @param data Topic data
+ * @return rt_int32_t Consumed length, negative value indicates error
+ */
+rt_int32_t mcn_deserialize(McnHub_t hub, const void* buffer, rt_uint32_t len, void* data)
+{
+    const McnSchema* schema;
+    const rt_uint8_t* in = (const rt_uint8_t*)buffer;
+    rt_uint32_t pos = 0;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+    MCN_ASSERT(data != RT_NULL);
+
+    schema = hub->schema;
+    if (schema == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+    for (rt_uint16_t i = 0; i < schema->field_num; i++) {
+        const McnField* field = &schema->fields[i];
+        rt_uint32_t fsize = field_size(field);
+
+        if (pos + fsize > len) {
+            return -RT_EEMPTY;
+        }
+        rt_memcpy((rt_uint8_t*)data + field->offset, &in[pos], fsize);
+        pos += fsize;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Format topic data into text, one field per line
+ *
+ * @param hub uMCN hub
+ * @param data Topic data
+ * @param buffer Output text buffer
+ * @param size Output buffer size
+ * @return rt_int32_t Text length, -RT_EFULL if buffer is too small
+ */
+rt_int32_t mcn_format(McnHub_t hub, const void* data, char* buffer, rt_uint32_t size)
+{
+    const McnSchema* schema;
+    rt_uint32_t len = 0;
+    int n;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(data != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    schema = hub->schema;
+    if (schema == RT_NULL) {
+        return -RT_ERROR;
+    }
+
+/* append text to buffer, bail out if truncated */
+#define FORMAT_APPEND(expr)           \
+    do {                              \
+        n = (expr);                   \
+        if (n < 0 || len + n >= size) \
+            return -RT_EFULL;         \
+        len += n;                     \
+    } while (0)
+
+    for (rt_uint16_t i = 0; i < schema->field_num; i++) {
+        const McnField* field = &schema->fields[i];
+        const rt_uint8_t* elem = (const rt_uint8_t*)data + field->offset;
+
+        FORMAT_APPEND(snprintf(&buffer[len], size - len, "%s: ", field->name));
+
+        if (field->type == MCN_TYPE_CHAR) {
+            FORMAT_APPEND(snprintf(&buffer[len], size - len, "%.*s", (int)field->count, (const char*)elem));
+        } else if (field->count == 1) {
+            FORMAT_APPEND(format_element(&buffer[len], size - len, field->type, elem));
+        } else {
+            FORMAT_APPEND(snprintf(&buffer[len], size - len, "["));
+            for (rt_uint16_t k = 0; k < field->count; k++) {
+                if (k) {
+                    FORMAT_APPEND(snprintf(&buffer[len], size - len, ", "));
+                }
+                FORMAT_APPEND(format_element(&buffer[len], size - len, field->type, elem));
+                elem += type_size[field->type];
+            }
+            FORMAT_APPEND(snprintf(&buffer[len], size - len, "]"));
+        }
+
+        FORMAT_APPEND(snprintf(&buffer[len], size - len, "\n"));
+    }
+
+#undef FORMAT_APPEND
+
+    return len;
+}
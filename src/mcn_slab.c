@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/*
+ * Buffers of variable size topics are rounded up to power of two size classes
+ * starting from 32 bytes. Released buffers are kept in a per-class free list,
+ * so publishing at a steady rate doesn't go through the heap. Buffers larger
+ * than the biggest class are allocated and freed directly.
+ *
+ * The slab lock is innermost, it's taken with a hub locked but never the
+ * other way around.
+ */
+#define SLAB_MIN_SHIFT 5
+
+#ifdef RT_USING_SMP
+static struct rt_spinlock slab_lock = MCN_SPINLOCK_INIT;
+#define SLAB_LOCK(level)   ((level) = rt_spin_lock_irqsave(&slab_lock))
+#define SLAB_UNLOCK(level) rt_spin_unlock_irqrestore(&slab_lock, level)
+#else
+#define SLAB_LOCK(level)   ((level) = 0, rt_enter_critical())
+#define SLAB_UNLOCK(level) ((void)(level), rt_exit_critical())
+#endif
+
+static struct mcn_buf* slab_free[MCN_SLAB_CLASS_NUM];
+static rt_uint8_t slab_free_num[MCN_SLAB_CLASS_NUM];
+/* bytes allocated from heap, including cached free buffers */
+static rt_uint32_t slab_bytes;
+
+/**
+ * @brief Get data size of slab buffer
+ */
+static rt_uint32_t slab_buf_size(rt_uint8_t cls, rt_uint32_t len)
+{
+    rt_uint32_t size = cls < MCN_SLAB_CLASS_NUM ? (1UL << (cls + SLAB_MIN_SHIFT)) : len;
+
+    return sizeof(struct mcn_buf) + size;
+}
+
+/**
+ * @brief Allocate a slab buffer
+ * @note The buffer is returned with one reference
+ *
+ * @param len Data length
+ * @return struct mcn_buf* Slab buffer, RT_NULL if out of memory
+ */
+struct mcn_buf* mcn_buf_alloc(rt_uint32_t len)
+{
+    struct mcn_buf* buf;
+    rt_uint8_t cls = 0;
+    rt_base_t level;
+
+    while (cls < MCN_SLAB_CLASS_NUM && (1UL << (cls + SLAB_MIN_SHIFT)) < len) {
+        cls++;
+    }
+
+    SLAB_LOCK(level);
+    buf = cls < MCN_SLAB_CLASS_NUM ? slab_free[cls] : RT_NULL;
+    if (buf != RT_NULL) {
+        slab_free[cls] = buf->next;
+        slab_free_num[cls]--;
+    }
+    SLAB_UNLOCK(level);
+
+    if (buf == RT_NULL) {
+        buf = (struct mcn_buf*)MCN_MALLOC(slab_buf_size(cls, len));
+        if (buf == RT_NULL) {
+            return RT_NULL;
+        }
+
+        SLAB_LOCK(level);
+        slab_bytes += slab_buf_size(cls, len);
+        SLAB_UNLOCK(level);
+    }
+
+    buf->ref = 1;
+    buf->len = len;
+    buf->cls = cls;
+    buf->next = RT_NULL;
+
+    return buf;
+}
+
+/**
+ * @brief Take a reference of slab buffer
+ *
+ * @param buf Slab buffer
+ */
+void mcn_buf_get(struct mcn_buf* buf)
+{
+    rt_base_t level;
+
+    SLAB_LOCK(level);
+    buf->ref++;
+    SLAB_UNLOCK(level);
+}
+
+/**
+ * @brief Release a reference of slab buffer
+ * @note The buffer is cached or freed when the last reference is released
+ *
+ * @param buf Slab buffer
+ */
+void mcn_buf_put(struct mcn_buf* buf)
+{
+    rt_bool_t free = RT_FALSE;
+    rt_base_t level;
+
+    SLAB_LOCK(level);
+    if (--buf->ref == 0) {
+        if (buf->cls < MCN_SLAB_CLASS_NUM && slab_free_num[buf->cls] < MCN_SLAB_CACHE_NUM) {
+            buf->next = slab_free[buf->cls];
+            slab_free[buf->cls] = buf;
+            slab_free_num[buf->cls]++;
+        } else {
+            slab_bytes -= slab_buf_size(buf->cls, buf->len);
+            free = RT_TRUE;
+        }
+    }
+    SLAB_UNLOCK(level);
+
+    if (free) {
+        MCN_FREE(buf);
+    }
+}
+
+/**
+ * @brief Get memory allocated for slab buffers
+ *
+ * @return rt_uint32_t Size in bytes
+ */
+rt_uint32_t mcn_slab_size(void)
+{
+    return slab_bytes;
+}
@@ -0,0 +1,288 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+#define TRACE_LINE_SIZE     160
+#define TRACE_MAX_THREADS   32
+/* scheduling slices are shown in a separate process, one track per core */
+#define TRACE_PID_CPU       0
+#define TRACE_PID_THREAD    1
+
+struct mcn_trace_event {
+    rt_uint64_t timestamp;
+    /* topic name, RT_NULL for thread switch */
+    const char* topic;
+    char thread[RT_NAME_MAX];
+    rt_uint8_t type;
+    rt_uint8_t cpu;
+};
+
+struct mcn_trace_ring {
+    /* monotonic write counter, slot is head % MCN_TRACE_BUFFER_SIZE */
+    rt_uint32_t head;
+    struct mcn_trace_event event[MCN_TRACE_BUFFER_SIZE];
+} MCN_CACHE_ALIGNED;
+
+volatile rt_bool_t mcn_trace_enabled;
+static struct mcn_trace_ring trace_ring[MCN_CPUS_NR];
+
+static const char* const trace_name[] = {
+    [MCN_TRACE_PUBLISH_BEGIN] = "publish",
+    [MCN_TRACE_PUBLISH_END] = "publish",
+    [MCN_TRACE_COPY] = "copy",
+    [MCN_TRACE_WAKEUP] = "wakeup",
+    [MCN_TRACE_CALLBACK_BEGIN] = "callback",
+    [MCN_TRACE_CALLBACK_END] = "callback",
+    [MCN_TRACE_SWITCH] = "running",
+};
+
+static const char trace_phase[] = {
+    [MCN_TRACE_PUBLISH_BEGIN] = 'B',
+    [MCN_TRACE_PUBLISH_END] = 'E',
+    [MCN_TRACE_COPY] = 'i',
+    [MCN_TRACE_WAKEUP] = 'i',
+    [MCN_TRACE_CALLBACK_BEGIN] = 'B',
+    [MCN_TRACE_CALLBACK_END] = 'E',
+    [MCN_TRACE_SWITCH] = 'B',
+};
+
+/**
+ * @brief Reserve a slot in trace ring
+ * @note Each context only owns the reserved slot, so no lock is held while
+ * filling the event
+ */
+rt_inline struct mcn_trace_event* trace_reserve(struct mcn_trace_ring* ring)
+{
+    rt_uint32_t idx;
+
+#ifdef RT_USING_SMP
+    idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+#else
+    /* cores without atomic instructions, only the increment is protected */
+    rt_base_t level = rt_hw_interrupt_disable();
+    idx = ring->head++;
+    rt_hw_interrupt_enable(level);
+#endif
+
+    return &ring->event[idx % MCN_TRACE_BUFFER_SIZE];
+}
+
+static void trace_fill(rt_uint8_t type, const char* topic, const char* thread)
+{
+    rt_uint8_t cpu = MCN_CPU_ID();
+    struct mcn_trace_event* event = trace_reserve(&trace_ring[cpu]);
+
+    event->timestamp = MCN_TIMESTAMP_US();
+    event->topic = topic;
+    event->type = type;
+    event->cpu = cpu;
+    if (thread != RT_NULL) {
+        rt_memcpy(event->thread, thread, RT_NAME_MAX);
+    } else {
+        mcn_get_owner(event->thread);
+    }
+}
+
+#if defined(UMCN_TRACE_USING_SCHED) && defined(RT_USING_HOOK)
+static void trace_scheduler_hook(struct rt_thread* from, struct rt_thread* to)
+{
+    if (mcn_trace_enabled) {
+        trace_fill(MCN_TRACE_SWITCH, RT_NULL, ((struct rt_object*)to)->name);
+    }
+}
+#endif
+
+/**
+ * @brief Record a trace event
+ *
+ * @param type Trace event type
+ * @param hub uMCN hub, can be RT_NULL if unknown
+ */
+void mcn_trace_record(rt_uint8_t type, McnHub_t hub)
+{
+    trace_fill(type, hub ? hub->obj_name : RT_NULL, RT_NULL);
+}
+
+/**
+ * @brief Drop references to the name of a topic being freed
+ *
+ * @param hub uMCN hub
+ */
+void mcn_trace_forget(McnHub_t hub)
+{
+    for (int cpu = 0; cpu < MCN_CPUS_NR; cpu++) {
+        for (int i = 0; i < MCN_TRACE_BUFFER_SIZE; i++) {
+            if (trace_ring[cpu].event[i].topic == hub->obj_name) {
+                trace_ring[cpu].event[i].topic = "(destroyed)";
+            }
+        }
+    }
+}
+
+/**
+ * @brief Start recording trace events, previous events are discarded
+ */
+void mcn_trace_start(void)
+{
+    mcn_trace_enabled = RT_FALSE;
+    for (int i = 0; i < MCN_CPUS_NR; i++) {
+        trace_ring[i].head = 0;
+    }
+#if defined(UMCN_TRACE_USING_SCHED) && defined(RT_USING_HOOK)
+    /* note this replaces scheduler hook set by others */
+    rt_scheduler_sethook(trace_scheduler_hook);
+#endif
+    mcn_trace_enabled = RT_TRUE;
+}
+
+/**
+ * @brief Stop recording trace events
+ */
+void mcn_trace_stop(void)
+{
+    mcn_trace_enabled = RT_FALSE;
+#if defined(UMCN_TRACE_USING_SCHED) && defined(RT_USING_HOOK)
+    rt_scheduler_sethook(RT_NULL);
+#endif
+}
+
+static void trace_printf(McnOutput_t output, void* ctx, const char* fmt, ...)
+{
+    char line[TRACE_LINE_SIZE];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return;
+    }
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+
+    output(ctx, line, len);
+}
+
+/* thread name hash used as trace tid */
+static rt_uint32_t trace_tid(const char* thread)
+{
+    rt_uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < RT_NAME_MAX && thread[i]; i++) {
+        hash = (hash ^ (rt_uint8_t)thread[i]) * 16777619u;
+    }
+
+    return hash & 0x7FFFFFFF;
+}
+
+/**
+ * @brief Dump trace events in Chrome JSON trace format
+ * @note Trace recording is stopped while dumping. The output can be loaded
+ * by chrome://tracing or Perfetto UI
+ *
+ * @param output Output function
+ * @param ctx Context passed to output function
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_trace_dump(McnOutput_t output, void* ctx)
+{
+    rt_uint32_t threads[TRACE_MAX_THREADS];
+    rt_uint32_t thread_num = 0;
+    rt_bool_t first = RT_TRUE;
+
+    MCN_ASSERT(output != RT_NULL);
+
+    mcn_trace_stop();
+
+    trace_printf(output, ctx, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (int cpu = 0; cpu < MCN_CPUS_NR; cpu++) {
+        struct mcn_trace_ring* ring = &trace_ring[cpu];
+        rt_uint32_t head = ring->head;
+        rt_uint32_t start = head > MCN_TRACE_BUFFER_SIZE ? head - MCN_TRACE_BUFFER_SIZE : 0;
+        rt_bool_t running = RT_FALSE;
+
+        trace_printf(output, ctx, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"cpu%d\"}}",
+            first ? "" : ",", TRACE_PID_CPU, cpu, cpu);
+        first = RT_FALSE;
+
+        for (rt_uint32_t i = start; i < head; i++) {
+            const struct mcn_trace_event* event = &ring->event[i % MCN_TRACE_BUFFER_SIZE];
+            char thread[RT_NAME_MAX + 1];
+            rt_uint32_t tid = trace_tid(event->thread);
+
+            rt_memcpy(thread, event->thread, RT_NAME_MAX);
+            thread[RT_NAME_MAX] = '\0';
+
+            if (event->type > MCN_TRACE_SWITCH) {
+                continue;
+            }
+
+            if (event->type == MCN_TRACE_SWITCH) {
+                if (running) {
+                    /* close the slice of previous thread on this core */
+                    trace_printf(output, ctx, ",\n{\"name\":\"running\",\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%llu}",
+                        TRACE_PID_CPU, cpu, (unsigned long long)event->timestamp);
+                }
+                trace_printf(output, ctx, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%llu}",
+                    thread, TRACE_PID_CPU, cpu, (unsigned long long)event->timestamp);
+                running = RT_TRUE;
+                continue;
+            }
+
+            rt_uint32_t k = 0;
+
+            while (k < thread_num && threads[k] != tid) {
+                k++;
+            }
+            if (k == thread_num) {
+                /* name the thread track on its first event */
+                trace_printf(output, ctx, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                    TRACE_PID_THREAD, (unsigned long)tid, thread);
+                if (thread_num < TRACE_MAX_THREADS) {
+                    threads[thread_num++] = tid;
+                }
+            }
+
+            trace_printf(output, ctx, ",\n{\"name\":\"%s%s%s\",\"ph\":\"%c\",%s\"pid\":%d,\"tid\":%lu,\"ts\":%llu,\"args\":{\"cpu\":%d}}",
+                trace_name[event->type], event->topic ? " " : "", event->topic ? event->topic : "", trace_phase[event->type],
+                trace_phase[event->type] == 'i' ? "\"s\":\"t\"," : "",
+                TRACE_PID_THREAD, (unsigned long)tid, (unsigned long long)event->timestamp, cpu);
+        }
+
+        if (running) {
+            /* the thread is still running at the end of trace */
+            const struct mcn_trace_event* last = &ring->event[(head - 1) % MCN_TRACE_BUFFER_SIZE];
+
+            trace_printf(output, ctx, ",\n{\"name\":\"running\",\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%llu}",
+                TRACE_PID_CPU, cpu, (unsigned long long)last->timestamp);
+        }
+    }
+
+    trace_printf(output, ctx, "\n]}\n");
+
+    return RT_EOK;
+}
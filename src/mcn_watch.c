@@ -0,0 +1,290 @@
+/******************************************************************************
+ * Copyright 2021 The Firmament Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#include <rtthread.h>
+#include <uMCN.h>
+
+#include "mcn_internal.h"
+
+/*
+ * Two level timer wheel. Each wheel step is MCN_WATCH_RESOLUTION ticks.
+ * Level 0 holds watches expiring within WHEEL_SIZE steps, level 1 holds
+ * the rest and is cascaded into level 0 once per WHEEL_SIZE steps. Longer
+ * deadlines are clamped and simply checked again when they expire.
+ *
+ * Publishing doesn't touch the wheel. A watch is only rechecked against the
+ * hub timestamp when its slot expires, so the cost per step doesn't depend
+ * on the number of topics or on the publish rate.
+ */
+#define WHEEL_BITS     6
+#define WHEEL_SIZE     (1UL << WHEEL_BITS)
+#define WHEEL_MASK     (WHEEL_SIZE - 1)
+#define WHEEL_MAX_STEP (WHEEL_SIZE * (WHEEL_SIZE - 1) - 1)
+#define STEP_US        ((rt_uint64_t)MCN_WATCH_RESOLUTION * 1000000 / RT_TICK_PER_SECOND)
+
+static McnWatch_t wheel[2][WHEEL_SIZE];
+/* current wheel step */
+static rt_uint32_t wheel_step;
+static struct rt_timer watch_timer;
+
+/**
+ * @brief Link watch into wheel slot
+ * @note Must be called in critical section
+ */
+static void wheel_insert(McnWatch_t watch, rt_uint32_t expire)
+{
+    rt_uint32_t delta;
+    McnWatch_t* slot;
+
+    /* don't link into a passed slot */
+    if ((rt_int32_t)(expire - wheel_step) < 0) {
+        expire = wheel_step + 1;
+    }
+    delta = expire - wheel_step;
+    if (delta > WHEEL_MAX_STEP) {
+        expire = wheel_step + WHEEL_MAX_STEP;
+        delta = WHEEL_MAX_STEP;
+    }
+
+    if (delta < WHEEL_SIZE) {
+        slot = &wheel[0][expire & WHEEL_MASK];
+    } else {
+        slot = &wheel[1][(expire >> WHEEL_BITS) & WHEEL_MASK];
+    }
+
+    watch->expire = expire;
+    watch->next = *slot;
+    if (watch->next) {
+        watch->next->pprev = &watch->next;
+    }
+    watch->pprev = slot;
+    *slot = watch;
+}
+
+/**
+ * @brief Unlink watch from wheel slot
+ * @note Must be called in critical section
+ */
+static void wheel_remove(McnWatch_t watch)
+{
+    *watch->pprev = watch->next;
+    if (watch->next) {
+        watch->next->pprev = watch->pprev;
+    }
+    watch->next = RT_NULL;
+    watch->pprev = RT_NULL;
+}
+
+/**
+ * @brief Convert a future timestamp to wheel step
+ */
+static rt_uint32_t wheel_expire(rt_uint64_t now, rt_uint64_t deadline)
+{
+    rt_uint64_t steps = deadline > now ? (deadline - now + STEP_US - 1) / STEP_US : 1;
+
+    return wheel_step + (steps > WHEEL_MAX_STEP ? WHEEL_MAX_STEP : (rt_uint32_t)steps);
+}
+
+/**
+ * @brief Check an expired watch against its hub and schedule the next check
+ * @note Must be called in critical section
+ *
+ * @return int 1 if becomes stale, 0 if recovered, -1 if nothing changed
+ */
+static int watch_check(McnWatch_t watch, rt_uint64_t now)
+{
+    McnHub_t hub = watch->hub;
+    rt_uint64_t timestamp;
+    int res = -1;
+    rt_base_t level;
+
+    MCN_HUB_LOCK(hub, level);
+    timestamp = hub->published ? hub->timestamp : 0;
+    MCN_HUB_UNLOCK(hub, level);
+
+    if (timestamp > watch->last) {
+        watch->last = timestamp;
+    }
+
+    if (now - watch->last >= watch->period) {
+        watch->missed++;
+        if (!watch->stale) {
+            watch->stale = 1;
+            res = 1;
+        }
+        /* keep checking each period until published again */
+        wheel_insert(watch, wheel_expire(now, now + watch->period));
+    } else {
+        if (watch->stale) {
+            watch->stale = 0;
+            res = 0;
+        }
+        wheel_insert(watch, wheel_expire(now, watch->last + watch->period));
+    }
+
+    return res;
+}
+
+/**
+ * @brief Timer wheel step entry
+ *
+ * @param parameter Unused
+ */
+static void watch_timer_entry(void* parameter)
+{
+    rt_base_t level;
+    rt_uint64_t now = MCN_TIMESTAMP_US();
+    McnWatch_t watch;
+
+    MCN_LOCK(level);
+
+    wheel_step++;
+
+    if ((wheel_step & WHEEL_MASK) == 0) {
+        /* cascade level 1 slot into level 0 */
+        McnWatch_t* slot = &wheel[1][(wheel_step >> WHEEL_BITS) & WHEEL_MASK];
+
+        while ((watch = *slot) != RT_NULL) {
+            wheel_remove(watch);
+            wheel_insert(watch, watch->expire);
+        }
+    }
+
+    /* watches are taken one by one, as the lock is released for callback */
+    while ((watch = wheel[0][wheel_step & WHEEL_MASK]) != RT_NULL) {
+        void (*timeout)(McnWatch_t watch, rt_bool_t stale) = watch->timeout;
+        int res;
+
+        wheel_remove(watch);
+        /* checked watch is rescheduled to a later slot */
+        res = watch_check(watch, now);
+
+        if (res >= 0 && timeout != RT_NULL) {
+            /* watch may be stopped inside callback */
+            MCN_UNLOCK(level);
+            timeout(watch, res ? RT_TRUE : RT_FALSE);
+            MCN_LOCK(level);
+        }
+    }
+
+    MCN_UNLOCK(level);
+}
+
+/**
+ * @brief Start watching a topic
+ * @note A topic can have multiple watches, e.g, one for each subscriber with
+ * its own deadline. The watch object must be kept until stopped, and must be
+ * stopped before being started again
+ *
+ * @param watch Watch object
+ * @param hub uMCN hub
+ * @param period_ms Expected maximal interval (ms) between two publishes
+ * @param timeout Callback when topic becomes stale or is published again, can be RT_NULL.
+ * It's called from timer context, so it should not block
+ * @param parameter User parameter
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_watch_start(McnWatch_t watch, McnHub_t hub, rt_uint32_t period_ms,
+    void (*timeout)(McnWatch_t watch, rt_bool_t stale), void* parameter)
+{
+    rt_base_t level;
+    rt_uint64_t now = MCN_TIMESTAMP_US();
+
+    MCN_ASSERT(watch != RT_NULL);
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (period_ms == 0 || period_ms > 0xFFFFFFFF / 1000) {
+        return -RT_EINVAL;
+    }
+
+    /* keep runtime created topic alive while watched */
+    if (mcn_hub_get(hub) != RT_EOK) {
+        return -RT_ERROR;
+    }
+
+    MCN_LOCK(level);
+
+    watch->hub = hub;
+    watch->period = period_ms * 1000;
+    watch->timeout = timeout;
+    watch->parameter = parameter;
+    watch->missed = 0;
+    watch->stale = 0;
+    /* deadline starts from now if not published yet */
+    watch->last = now;
+    watch->active = 1;
+    wheel_insert(watch, wheel_expire(now, now + watch->period));
+
+    MCN_UNLOCK(level);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Stop watching a topic
+ *
+ * @param watch Watch object
+ */
+void mcn_watch_stop(McnWatch_t watch)
+{
+    rt_bool_t active;
+    rt_base_t level;
+
+    MCN_ASSERT(watch != RT_NULL);
+
+    MCN_LOCK(level);
+    active = watch->active;
+    if (active) {
+        wheel_remove(watch);
+        watch->active = 0;
+    }
+    MCN_UNLOCK(level);
+
+    if (active) {
+        mcn_release(watch->hub);
+    }
+}
+
+/**
+ * @brief Check if the watched topic has missed its deadline
+ * @note The flag is cleared at the first check after topic is published
+ * again, which is at most one period later
+ *
+ * @param watch Watch object
+ * @return rt_bool_t RT_TRUE if topic is stale
+ */
+rt_bool_t mcn_watch_is_stale(McnWatch_t watch)
+{
+    MCN_ASSERT(watch != RT_NULL);
+
+    return watch->stale ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Start the watchdog timer wheel
+ *
+ * @return int RT_EOK indicates success
+ */
+int mcn_watch_init(void)
+{
+    rt_timer_init(&watch_timer, "mcn_watch",
+        watch_timer_entry,
+        RT_NULL,
+        MCN_WATCH_RESOLUTION,
+        RT_TIMER_FLAG_PERIODIC | RT_TIMER_FLAG_SOFT_TIMER);
+
+    return rt_timer_start(&watch_timer);
+}
@@ -18,34 +18,358 @@
 #include <rtthread.h>
 #include <uMCN.h>
 
+#include "mcn_internal.h"
+
+#define FREQ_EST_SLOT_NUM (MCN_FREQ_EST_WINDOW_LEN + 1)
+
 #define DBG_TAG    "uMCN"
 #define DBG_LVL    DBG_INFO
 #include <rtdbg.h>
 
-static McnList __mcn_list = { .hub = RT_NULL, .next = RT_NULL };
-static struct rt_timer timer_mcn_freq_est;
+/* sentinel of topic list, topics are linked in advertise order */
+static McnList __mcn_list = { .hub = RT_NULL, .next = RT_NULL, .prev = RT_NULL, .hash_next = RT_NULL };
+static McnList_t __mcn_list_tail = &__mcn_list;
+/* topic registry hash table, bucket number is power of 2 */
+static McnList_t* __mcn_table;
+static rt_uint32_t __mcn_table_size;
+static rt_uint32_t __mcn_topic_num;
+#ifdef RT_USING_SMP
+struct rt_spinlock __mcn_lock = MCN_SPINLOCK_INIT;
+#endif
+
+#ifndef UMCN_USING_COMPACT
+/**
+ * @brief Count a publish in the freq estimate window
+ * @note Must be called with hub locked, after hub timestamp is updated
+ *
+ * @param hub uMCN hub
+ */
+rt_inline void mcn_freq_count(McnHub_t hub)
+{
+    rt_uint32_t slot = (rt_uint32_t)(hub->timestamp >> MCN_FREQ_EST_SLOT_SHIFT);
+
+    if (slot != hub->window_slot) {
+        /* clear slots skipped since last publish */
+        rt_uint32_t n = slot - hub->window_slot;
+
+        if (n > FREQ_EST_SLOT_NUM) {
+            n = FREQ_EST_SLOT_NUM;
+        }
+        while (n--) {
+            hub->freq_est_window[(slot - n) % FREQ_EST_SLOT_NUM] = 0;
+        }
+        hub->window_slot = slot;
+    }
+    hub->freq_est_window[slot % FREQ_EST_SLOT_NUM]++;
+}
+#endif
+
+/**
+ * @brief Get topic publish frequency
+ * @note The frequency is averaged over the last MCN_FREQ_EST_WINDOW_LEN
+ * complete slots. It is computed on demand, so nothing runs periodically.
+ * With UMCN_USING_COMPACT the estimator is removed and 0 is returned
+ *
+ * @param hub uMCN hub
+ * @return float Publish frequency (Hz)
+ */
+float mcn_get_freq(McnHub_t hub)
+{
+#ifdef UMCN_USING_COMPACT
+    MCN_ASSERT(hub != RT_NULL);
+
+    return 0.0f;
+#else
+    rt_base_t level;
+    rt_uint32_t now = (rt_uint32_t)(MCN_TIMESTAMP_US() >> MCN_FREQ_EST_SLOT_SHIFT);
+    rt_uint32_t cnt = 0;
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    MCN_HUB_LOCK(hub, level);
+    for (rt_uint32_t i = 1; i <= MCN_FREQ_EST_WINDOW_LEN && i <= now; i++) {
+        rt_uint32_t slot = now - i;
 
+        /* only slots still kept in window count */
+        if (slot <= hub->window_slot && hub->window_slot - slot < FREQ_EST_SLOT_NUM) {
+            cnt += hub->freq_est_window[slot % FREQ_EST_SLOT_NUM];
+        }
+    }
+    MCN_HUB_UNLOCK(hub, level);
+
+    return (float)cnt * 1e6f / (float)((rt_uint64_t)MCN_FREQ_EST_WINDOW_LEN << MCN_FREQ_EST_SLOT_SHIFT);
+#endif
+}
+
+#if defined(UMCN_USING_GRAPH) || defined(UMCN_USING_TRACE)
 /**
- * @brief Topic publish frequency estimator entry
+ * @brief Get owner name of current context
  *
- * @param parameter Unused
+ * @param owner Buffer of RT_NAME_MAX bytes to receive the name
+ */
+void mcn_get_owner(char* owner)
+{
+    rt_thread_t tid = rt_thread_self();
+
+    if (rt_interrupt_get_nest() > 0) {
+        rt_strncpy(owner, "isr", RT_NAME_MAX);
+    } else if (tid == RT_NULL) {
+        /* scheduler not started yet */
+        rt_strncpy(owner, "init", RT_NAME_MAX);
+    } else {
+        /* name is the first member of thread object */
+        rt_strncpy(owner, ((struct rt_object*)tid)->name, RT_NAME_MAX);
+    }
+}
+#endif
+
+#ifdef UMCN_USING_PARTIAL
+/**
+ * @brief Get the dirty chunks touched by a range of topic data
+ */
+rt_inline rt_uint32_t mcn_dirty_chunks(McnHub_t hub, rt_uint32_t offset, rt_uint32_t len)
+{
+    rt_uint32_t chunk_size = MCN_DIRTY_CHUNK_SIZE(hub);
+    rt_uint32_t first = offset / chunk_size;
+    rt_uint32_t last = (offset + len - 1) / chunk_size;
+
+    if (last - first + 1 >= MCN_DIRTY_CHUNK_NUM) {
+        return 0xFFFFFFFF;
+    }
+
+    return ((1UL << (last - first + 1)) - 1) << first;
+}
+
+/**
+ * @brief Get the dirty chunks fully covered by a range of topic data
+ */
+rt_inline rt_uint32_t mcn_covered_chunks(McnHub_t hub, rt_uint32_t offset, rt_uint32_t len)
+{
+    rt_uint32_t chunk_size = MCN_DIRTY_CHUNK_SIZE(hub);
+    rt_uint32_t first = (offset + chunk_size - 1) / chunk_size;
+    rt_uint32_t end = offset + len;
+    rt_uint32_t last;
+
+    /* the last chunk may be shorter than chunk size */
+    if (end >= hub->obj_size) {
+        last = MCN_DIRTY_CHUNK_NUM;
+    } else {
+        last = end / chunk_size;
+    }
+
+    if (last <= first) {
+        return 0;
+    }
+    if (last - first >= MCN_DIRTY_CHUNK_NUM) {
+        return 0xFFFFFFFF;
+    }
+
+    return ((1UL << (last - first)) - 1) << first;
+}
+#endif
+
+/**
+ * @brief Hash of topic name (FNV-1a)
+ */
+static rt_uint32_t mcn_hash(const char* name)
+{
+    rt_uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash = (hash ^ (rt_uint8_t)*name++) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Look up registry entry by topic name
+ * @note Must be called in critical section
  */
-static void mcn_freq_est_entry(void* parameter)
+static McnList_t mcn_lookup(const char* name)
 {
-    for (McnList_t cp = &__mcn_list; cp != RT_NULL; cp = cp->next) {
-        McnHub_t hub = cp->hub;
-        if (hub == RT_NULL) {
+    if (__mcn_table == RT_NULL) {
+        return RT_NULL;
+    }
+
+    for (McnList_t entry = __mcn_table[mcn_hash(name) & (__mcn_table_size - 1)]; entry != RT_NULL;
+         entry = entry->hash_next) {
+        if (strcmp(entry->hub->obj_name, name) == 0) {
+            return entry;
+        }
+    }
+
+    return RT_NULL;
+}
+
+/**
+ * @brief Link entry into registry hash bucket
+ * @note Must be called in critical section
+ */
+static void mcn_hash_insert(McnList_t* table, rt_uint32_t size, McnList_t entry)
+{
+    McnList_t* bucket = &table[mcn_hash(entry->hub->obj_name) & (size - 1)];
+
+    entry->hash_next = *bucket;
+    *bucket = entry;
+}
+
+/**
+ * @brief Unlink entry from registry hash bucket
+ * @note Must be called in critical section
+ */
+static void mcn_hash_remove(McnList_t entry)
+{
+    McnList_t* pp = &__mcn_table[mcn_hash(entry->hub->obj_name) & (__mcn_table_size - 1)];
+
+    for (; *pp != RT_NULL; pp = &(*pp)->hash_next) {
+        if (*pp == entry) {
+            *pp = entry->hash_next;
+            entry->hash_next = RT_NULL;
             break;
         }
-        /* calculate publish frequency */
-        rt_uint32_t cnt = 0;
-        for (int i = 0; i < MCN_FREQ_EST_WINDOW_LEN; i++) {
-            cnt += hub->freq_est_window[i];
-            hub->freq = (float)cnt / MCN_FREQ_EST_WINDOW_LEN;
+    }
+}
+
+/**
+ * @brief Move all registry entries into a larger hash table
+ * @note Must be called in critical section
+ *
+ * @return McnList_t* The old table to be freed
+ */
+static McnList_t* mcn_rehash(McnList_t* table, rt_uint32_t size)
+{
+    McnList_t* old_table = __mcn_table;
+
+    memset(table, 0, size * sizeof(McnList_t));
+    for (McnList_t entry = __mcn_list.next; entry != RT_NULL; entry = entry->next) {
+        if (!entry->hub->destroyed) {
+            mcn_hash_insert(table, size, entry);
+        }
+    }
+    __mcn_table = table;
+    __mcn_table_size = size;
+
+    return old_table;
+}
+
+/**
+ * @brief Allocate data storage of topic
+ */
+static void* mcn_data_alloc(McnHub_t hub)
+{
+    void* pdata;
+
+#ifdef UMCN_USING_VARSIZE
+    if (hub->varsize) {
+        /* empty until published, each publish brings its own buffer */
+        struct mcn_buf* buf = mcn_buf_alloc(0);
+
+        return buf != RT_NULL ? (void*)buf->data : RT_NULL;
+    }
+#endif
+
+    pdata = MCN_MALLOC_ALIGN(hub->obj_size);
+    if (pdata != RT_NULL) {
+        memset(pdata, 0, hub->obj_size);
+    }
+
+    return pdata;
+}
+
+/**
+ * @brief Free data storage of topic
+ */
+static void mcn_data_free(McnHub_t hub, void* pdata)
+{
+#ifdef UMCN_USING_VARSIZE
+    if (hub->varsize) {
+        mcn_buf_put(MCN_BUF_OF(pdata));
+        return;
+    }
+#endif
+    MCN_FREE_ALIGN(pdata);
+}
+
+/**
+ * @brief Free a topic created by mcn_create()
+ * @note Called when the last reference is released, no one can access it anymore
+ */
+static void mcn_hub_free(McnHub_t hub)
+{
+#ifdef UMCN_USING_TRACE
+    mcn_trace_forget(hub);
+#endif
+#ifdef UMCN_USING_HISTORY
+    MCN_FREE(hub->history);
+#endif
+    mcn_data_free(hub, hub->pdata);
+    MCN_FREE_ALIGN(hub);
+}
+
+/**
+ * @brief Take a reference of topic
+ * @note Static topics are not reference counted
+ *
+ * @param hub uMCN hub
+ * @return rt_err_t RT_EOK indicates success, -RT_ERROR if topic is destroyed
+ */
+rt_err_t mcn_hub_get(McnHub_t hub)
+{
+    rt_err_t err = RT_EOK;
+    rt_base_t level;
+
+    if (hub->ref == 0) {
+        return RT_EOK;
+    }
+
+    MCN_LOCK(level);
+    if (hub->destroyed) {
+        err = -RT_ERROR;
+    } else {
+        hub->ref++;
+    }
+    MCN_UNLOCK(level);
+
+    return err;
+}
+
+/**
+ * @brief Release a reference of topic
+ * @note Topic created by mcn_create() is freed when the last reference,
+ * e.g, a subscribe node, is released after mcn_destroy()
+ *
+ * @param hub uMCN hub
+ */
+void mcn_release(McnHub_t hub)
+{
+    rt_bool_t last = RT_FALSE;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (hub->ref == 0) {
+        /* static topic */
+        return;
+    }
+
+    MCN_LOCK(level);
+    if (--hub->ref == 0) {
+        McnList_t entry = &hub->entry;
+
+        /* unlink from topic list, iterators hold a reference so none stays on it */
+        entry->prev->next = entry->next;
+        if (entry->next != RT_NULL) {
+            entry->next->prev = entry->prev;
+        } else {
+            __mcn_list_tail = entry->prev;
         }
-        /* move window */
-        hub->window_index = (hub->window_index + 1) % MCN_FREQ_EST_WINDOW_LEN;
-        hub->freq_est_window[hub->window_index] = 0;
+        last = RT_TRUE;
+    }
+    MCN_UNLOCK(level);
+
+    if (last) {
+        mcn_hub_free(hub);
     }
 }
 
@@ -62,9 +386,11 @@ void mcn_node_clear(McnNode_t node_t)
         return;
     }
 
-    MCN_ENTER_CRITICAL;
-    node_t->renewal = 0;
-    MCN_EXIT_CRITICAL;
+    /* single word store, no lock is needed */
+    MCN_NODE_CLEAR_RENEWAL(node_t);
+#ifdef UMCN_USING_PARTIAL
+    node_t->dirty = 0;
+#endif
 }
 
 /**
@@ -89,6 +415,8 @@ void mcn_resume(McnHub_t hub)
 
 /**
  * @brief Get uMCN list
+ * @note The returned entry is the list head, pass it to mcn_iterate() to
+ * iterate all topics
  *
  * @return McnList_t uMCN list pointer
  */
@@ -99,22 +427,52 @@ McnList_t mcn_get_list(void)
 
 /**
  * @brief Iterate all uMCN hubs in list
+ * @note The returned hub is kept alive until the next call. If iteration is
+ * stopped before RT_NULL is returned, call mcn_iterate_end()
  *
  * @param ite uMCN list pointer
  * @return McnHub_t uMCN hub
  */
 McnHub_t mcn_iterate(McnList_t* ite)
 {
-    McnHub_t hub;
-    McnList_t node = *ite;
+    McnList_t cur = *ite;
+    McnList_t next;
+    rt_base_t level;
 
-    if (node == RT_NULL) {
+    if (cur == RT_NULL) {
         return RT_NULL;
     }
-    hub = node->hub;
-    *ite = node->next;
 
-    return hub;
+    MCN_LOCK(level);
+    /* current entry is held, so its next link is valid */
+    next = cur->next;
+    while (next != RT_NULL && next->hub->destroyed) {
+        next = next->next;
+    }
+    if (next != RT_NULL && next->hub->ref) {
+        next->hub->ref++;
+    }
+    MCN_UNLOCK(level);
+
+    *ite = next;
+    if (cur->hub != RT_NULL) {
+        mcn_release(cur->hub);
+    }
+
+    return next ? next->hub : RT_NULL;
+}
+
+/**
+ * @brief Stop iterating uMCN hubs before the end of list
+ *
+ * @param ite uMCN list pointer
+ */
+void mcn_iterate_end(McnList_t* ite)
+{
+    if (*ite != RT_NULL && (*ite)->hub != RT_NULL) {
+        mcn_release((*ite)->hub);
+    }
+    *ite = RT_NULL;
 }
 
 /**
@@ -127,15 +485,10 @@ McnHub_t mcn_iterate(McnList_t* ite)
  */
 rt_bool_t mcn_poll(McnNode_t node_t)
 {
-    rt_bool_t renewal;
-
     MCN_ASSERT(node_t != RT_NULL);
 
-    MCN_ENTER_CRITICAL;
-    renewal = node_t->renewal;
-    MCN_EXIT_CRITICAL;
-
-    return renewal;
+    /* single byte load, no lock is needed */
+    return MCN_NODE_RENEWAL(node_t) ? RT_TRUE : RT_FALSE;
 }
 
 /**
@@ -150,9 +503,13 @@ rt_bool_t mcn_poll(McnNode_t node_t)
 rt_bool_t mcn_poll_sync(McnNode_t node_t, rt_int32_t timeout)
 {
     MCN_ASSERT(node_t != RT_NULL);
-    MCN_ASSERT(node_t->event != RT_NULL);
+    MCN_ASSERT(MCN_NODE_EVENT(node_t) != RT_NULL);
+
+    if (MCN_WAIT_EVENT(MCN_NODE_EVENT(node_t), timeout) != 0) {
+        return RT_FALSE;
+    }
 
-    return MCN_WAIT_EVENT(node_t->event, timeout) == 0 ? RT_TRUE : RT_FALSE;
+    return RT_TRUE;
 }
 
 /**
@@ -166,6 +523,8 @@ rt_bool_t mcn_poll_sync(McnNode_t node_t, rt_int32_t timeout)
  */
 rt_err_t mcn_copy(McnHub_t hub, McnNode_t node_t, void* buffer)
 {
+    rt_base_t level;
+
     MCN_ASSERT(hub != RT_NULL);
     MCN_ASSERT(node_t != RT_NULL);
     MCN_ASSERT(buffer != RT_NULL);
@@ -180,10 +539,15 @@ rt_err_t mcn_copy(McnHub_t hub, McnNode_t node_t, void* buffer)
         return -RT_ERROR;
     }
 
-    MCN_ENTER_CRITICAL;
-    rt_memcpy(buffer, hub->pdata, hub->obj_size);
-    node_t->renewal = 0;
-    MCN_EXIT_CRITICAL;
+    MCN_HUB_LOCK(hub, level);
+    mcn_memcpy(buffer, hub->pdata, MCN_HUB_DATA_LEN(hub));
+    MCN_NODE_CLEAR_RENEWAL(node_t);
+#ifdef UMCN_USING_PARTIAL
+    node_t->dirty = 0;
+#endif
+    MCN_HUB_UNLOCK(hub, level);
+
+    MCN_TRACE(MCN_TRACE_COPY, hub);
 
     return RT_EOK;
 }
@@ -199,6 +563,8 @@ rt_err_t mcn_copy(McnHub_t hub, McnNode_t node_t, void* buffer)
  */
 rt_err_t mcn_copy_from_hub(McnHub_t hub, void* buffer)
 {
+    rt_base_t level;
+
     MCN_ASSERT(hub != RT_NULL);
     MCN_ASSERT(buffer != RT_NULL);
 
@@ -212,9 +578,11 @@ rt_err_t mcn_copy_from_hub(McnHub_t hub, void* buffer)
         return -RT_ERROR;
     }
 
-    MCN_ENTER_CRITICAL;
-    rt_memcpy(buffer, hub->pdata, hub->obj_size);
-    MCN_EXIT_CRITICAL;
+    MCN_HUB_LOCK(hub, level);
+    mcn_memcpy(buffer, hub->pdata, MCN_HUB_DATA_LEN(hub));
+    MCN_HUB_UNLOCK(hub, level);
+
+    MCN_TRACE(MCN_TRACE_COPY, hub);
 
     return RT_EOK;
 }
@@ -223,13 +591,17 @@ rt_err_t mcn_copy_from_hub(McnHub_t hub, void* buffer)
  * @brief Advertise a uMCN topic
  *
  * @param hub uMCN hub
- * @param echo Echo function to print topic contents
- * @return rt_err_t RT_EOK indicates success
+ * @param echo Echo function to print topic contents, ignored with UMCN_USING_COMPACT
+ * @return rt_err_t RT_EOK indicates success, -RT_EBUSY if the name is used
  */
 rt_err_t mcn_advertise(McnHub_t hub, int (*echo)(void* parameter))
 {
     void* pdata;
-    void* next;
+    McnList_t entry = &hub->entry;
+    McnList_t* table = RT_NULL;
+    rt_uint32_t table_size = __mcn_table_size;
+    rt_err_t err = RT_EOK;
+    rt_base_t level;
 
     MCN_ASSERT(hub != RT_NULL);
 
@@ -238,47 +610,217 @@ rt_err_t mcn_advertise(McnHub_t hub, int (*echo)(void* parameter))
         return -RT_ERROR;
     }
 
-    pdata = MCN_MALLOC(hub->obj_size);
+    pdata = mcn_data_alloc(hub);
     if (pdata == RT_NULL) {
         return -RT_ENOMEM;
     }
-    memset(pdata, 0, hub->obj_size);
 
-    next = MCN_MALLOC(sizeof(McnList));
-    if (next == RT_NULL) {
-        MCN_FREE(pdata);
-        return -RT_ENOMEM;
+    /* allocate a larger hash table ahead if registry is getting crowded */
+    if (__mcn_topic_num + 1 > table_size * 2) {
+        table_size = table_size ? table_size * 2 : MCN_HASH_INIT_SIZE;
+        table = (McnList_t*)MCN_MALLOC(table_size * sizeof(McnList_t));
+        if (table == RT_NULL && __mcn_table == RT_NULL) {
+            mcn_data_free(hub, pdata);
+            return -RT_ENOMEM;
+        }
+    }
+
+    MCN_LOCK(level);
+
+    if (hub->pdata != RT_NULL) {
+        err = -RT_ERROR;
+    } else if (mcn_lookup(hub->obj_name) != RT_NULL) {
+        err = -RT_EBUSY;
+    } else {
+        if (table != RT_NULL && table_size > __mcn_table_size) {
+            /* the old table is freed below */
+            table = mcn_rehash(table, table_size);
+        }
+
+        hub->pdata = pdata;
+#ifndef UMCN_USING_COMPACT
+        hub->echo = echo;
+#endif
+
+        /* update Mcn List */
+        entry->hub = hub;
+        entry->next = RT_NULL;
+        entry->prev = __mcn_list_tail;
+        __mcn_list_tail->next = entry;
+        __mcn_list_tail = entry;
+        mcn_hash_insert(__mcn_table, __mcn_table_size, entry);
+        __mcn_topic_num++;
+
+#ifndef UMCN_USING_COMPACT
+        /* init publish freq estimator window */
+        memset(hub->freq_est_window, 0, sizeof(hub->freq_est_window));
+        hub->window_slot = 0;
+#endif
+    }
+
+    MCN_UNLOCK(level);
+
+    MCN_FREE(table);
+    if (err != RT_EOK) {
+        mcn_data_free(hub, pdata);
+    }
+
+#ifdef UMCN_USING_PERSIST
+    if (err == RT_EOK && hub->persist) {
+        /* restore last value before anyone subscribes by pattern */
+        mcn_persist_restore(hub);
+    }
+#endif
+#ifdef UMCN_USING_PATTERN
+    if (err == RT_EOK) {
+        /* attach pattern subscriptions matching the new topic */
+        mcn_pattern_bind(hub);
     }
+#endif
 
-    MCN_ENTER_CRITICAL;
-    hub->pdata = pdata;
-    hub->echo = echo;
+    return err;
+}
+
+/**
+ * @brief Allocate and advertise a runtime topic
+ */
+static McnHub_t mcn_create_hub(const char* name, rt_uint32_t size, int (*echo)(void* parameter), rt_bool_t varsize)
+{
+    rt_size_t len;
+    McnHub_t hub;
 
-    /* update Mcn List */
-    McnList_t cp = &__mcn_list;
+    MCN_ASSERT(name != RT_NULL);
 
-    while (cp->next != RT_NULL) {
-        /* find last node */
-        cp = cp->next;
+    len = strlen(name);
+    if (len == 0 || len > MCN_NAME_MAX_LEN) {
+        LOG_E("invalid topic name length!");
+        return RT_NULL;
+    }
+    len += 1;
+    /* name is stored right after the hub */
+    hub = (McnHub_t)MCN_MALLOC_ALIGN(sizeof(McnHub) + len);
+    if (hub == RT_NULL) {
+        return RT_NULL;
+    }
+    memset(hub, 0, sizeof(McnHub));
+#ifdef RT_USING_SMP
+    rt_spin_lock_init(&hub->lock);
+#endif
+    rt_memcpy(hub + 1, name, len);
+    hub->obj_name = (const char*)(hub + 1);
+    *(rt_uint32_t*)&hub->obj_size = size;
+#ifdef UMCN_USING_VARSIZE
+    hub->varsize = varsize;
+#endif
+    /* reference of the creator, released by mcn_destroy() */
+    hub->ref = 1;
+
+    if (mcn_advertise(hub, echo) != RT_EOK) {
+        MCN_FREE_ALIGN(hub);
+        return RT_NULL;
     }
 
-    if (cp->hub != RT_NULL) {
-        cp->next = (McnList_t)next;
-        cp = cp->next;
+    return hub;
+}
+
+/**
+ * @brief Create and advertise a uMCN topic at runtime
+ *
+ * @param name Topic name, copied into the topic
+ * @param size Topic data size
+ * @param echo Echo function to print topic contents
+ * @return McnHub_t uMCN hub, RT_NULL if fail, the name is used, empty or
+ * longer than MCN_NAME_MAX_LEN
+ */
+McnHub_t mcn_create(const char* name, rt_uint32_t size, int (*echo)(void* parameter))
+{
+    return mcn_create_hub(name, size, echo, RT_FALSE);
+}
+
+#ifdef UMCN_USING_VARSIZE
+/**
+ * @brief Create and advertise a variable size uMCN topic at runtime
+ *
+ * @param name Topic name, copied into the topic
+ * @param max_size Maximal topic data size
+ * @param echo Echo function to print topic contents
+ * @return McnHub_t uMCN hub, RT_NULL if fail, the name is used, empty or
+ * longer than MCN_NAME_MAX_LEN
+ */
+McnHub_t mcn_create_var(const char* name, rt_uint32_t max_size, int (*echo)(void* parameter))
+{
+    return mcn_create_hub(name, max_size, echo, RT_TRUE);
+}
+#endif
+
+/**
+ * @brief Destroy a uMCN topic created by mcn_create()
+ * @note The topic can't be found, published or subscribed anymore. Existing
+ * subscribers can still read the last data, the topic is freed when all of
+ * them are unsubscribed. Pattern subscriptions are unsubscribed at once
+ *
+ * @param hub uMCN hub
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_destroy(McnHub_t hub)
+{
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+
+    if (hub->ref == 0) {
+        /* static topic can't be destroyed */
+        return -RT_EINVAL;
     }
 
-    cp->hub = hub;
-    cp->next = RT_NULL;
+    MCN_LOCK(level);
+    if (hub->destroyed) {
+        MCN_UNLOCK(level);
+        return -RT_ERROR;
+    }
+    hub->destroyed = 1;
+    mcn_hash_remove(&hub->entry);
+    __mcn_topic_num--;
+    MCN_UNLOCK(level);
 
-    /* init publish freq estimator window */
-    memset(hub->freq_est_window, 0, 2 * MCN_FREQ_EST_WINDOW_LEN);
-    hub->window_index = 0;
+#ifdef UMCN_USING_PATTERN
+    /* drop pattern subscriptions, which keep the topic alive */
+    mcn_pattern_unbind(hub);
+#endif
 
-    MCN_EXIT_CRITICAL;
+    mcn_release(hub);
 
     return RT_EOK;
 }
 
+/**
+ * @brief Find an advertised uMCN topic by name
+ * @note The topic is kept alive until mcn_release() is called
+ *
+ * @param name Topic name
+ * @return McnHub_t uMCN hub, RT_NULL if not found
+ */
+McnHub_t mcn_find(const char* name)
+{
+    McnList_t entry;
+    McnHub_t hub = RT_NULL;
+    rt_base_t level;
+
+    MCN_ASSERT(name != RT_NULL);
+
+    MCN_LOCK(level);
+    entry = mcn_lookup(name);
+    if (entry != RT_NULL) {
+        hub = entry->hub;
+        if (hub->ref) {
+            hub->ref++;
+        }
+    }
+    MCN_UNLOCK(level);
+
+    return hub;
+}
+
 /**
  * @brief Subscribe a uMCN topic
  *
@@ -289,6 +831,9 @@ rt_err_t mcn_advertise(McnHub_t hub, int (*echo)(void* parameter))
  */
 McnNode_t mcn_subscribe(McnHub_t hub, MCN_EVENT_HANDLE event, void (*pub_cb)(void* parameter))
 {
+    void* pdata = RT_NULL;
+    rt_base_t level;
+
     MCN_ASSERT(hub != RT_NULL);
 
     if (hub->link_num >= MCN_MAX_LINK_NUM) {
@@ -296,19 +841,42 @@ McnNode_t mcn_subscribe(McnHub_t hub, MCN_EVENT_HANDLE event, void (*pub_cb)(voi
         return RT_NULL;
     }
 
-    McnNode_t node = (McnNode_t)MCN_MALLOC(sizeof(McnNode));
+    McnNode_t node = (McnNode_t)MCN_MALLOC_ALIGN(sizeof(McnNode));
 
     if (node == RT_NULL) {
         LOG_E("mcn create node fail!");
         return RT_NULL;
     }
 
+    /* each node holds a reference of the topic */
+    if (mcn_hub_get(hub) != RT_EOK) {
+        MCN_FREE_ALIGN(node);
+        return RT_NULL;
+    }
+
+#ifdef UMCN_USING_COMPACT
+    node->event = (rt_ubase_t)event;
+#else
     node->renewal = 0;
     node->event = event;
+#endif
+#ifdef UMCN_USING_PARTIAL
+    node->dirty = 0;
+#endif
     node->pub_cb = pub_cb;
     node->next = RT_NULL;
-
-    MCN_ENTER_CRITICAL;
+#ifdef UMCN_USING_GROUP
+    node->group = RT_NULL;
+    node->group_index = 0;
+#endif
+#ifdef UMCN_USING_GRAPH
+    mcn_get_owner(node->owner);
+    node->delivered = 0;
+    node->dropped = 0;
+    node->cb_time = 0;
+#endif
+
+    MCN_HUB_LOCK(hub, level);
 
     /* no node link yet */
     if (hub->link_tail == RT_NULL) {
@@ -319,16 +887,34 @@ McnNode_t mcn_subscribe(McnHub_t hub, MCN_EVENT_HANDLE event, void (*pub_cb)(voi
     }
 
     hub->link_num++;
-    MCN_EXIT_CRITICAL;
 
     if (hub->published) {
+        pdata = hub->pdata;
+#ifdef UMCN_USING_VARSIZE
+        if (hub->varsize) {
+            /* hold the buffer for callback, it may be replaced by publisher */
+            mcn_buf_get(MCN_BUF_OF(pdata));
+        }
+#endif
+    }
+    MCN_HUB_UNLOCK(hub, level);
+
+    if (pdata != RT_NULL) {
         /* update renewal flag as it's already published */
-        node->renewal = 1;
+        MCN_NODE_SET_RENEWAL(node);
+#ifdef UMCN_USING_PARTIAL
+        node->dirty = 0xFFFFFFFF;
+#endif
 
         if (node->pub_cb) {
             /* if data published before subscribe, then call callback immediately */
-            node->pub_cb(hub->pdata);
+            node->pub_cb(pdata);
+        }
+#ifdef UMCN_USING_VARSIZE
+        if (hub->varsize) {
+            mcn_buf_put(MCN_BUF_OF(pdata));
         }
+#endif
     }
 
     return node;
@@ -343,9 +929,13 @@ McnNode_t mcn_subscribe(McnHub_t hub, MCN_EVENT_HANDLE event, void (*pub_cb)(voi
  */
 rt_err_t mcn_unsubscribe(McnHub_t hub, McnNode_t node)
 {
+    rt_base_t level;
+
     MCN_ASSERT(hub != RT_NULL);
     MCN_ASSERT(node != RT_NULL);
 
+    MCN_HUB_LOCK(hub, level);
+
     /* traverse each node */
     McnNode_t cur_node = hub->link_head;
     McnNode_t pre_node = RT_NULL;
@@ -362,12 +952,11 @@ rt_err_t mcn_unsubscribe(McnHub_t hub, McnNode_t node)
 
     if (cur_node == RT_NULL) {
         /* can not find */
+        MCN_HUB_UNLOCK(hub, level);
         return -RT_EEMPTY;
     }
 
     /* update list */
-    MCN_ENTER_CRITICAL;
-
     if (hub->link_num == 1) {
         hub->link_head = hub->link_tail = RT_NULL;
     } else {
@@ -384,76 +973,777 @@ rt_err_t mcn_unsubscribe(McnHub_t hub, McnNode_t node)
     }
 
     hub->link_num--;
+#ifdef UMCN_USING_GRAPH
+    if (hub->cb_node == cur_node) {
+        /* unsubscribed inside its callback, don't account callback time */
+        hub->cb_node = RT_NULL;
+    }
+#endif
 
-    MCN_EXIT_CRITICAL;
+    MCN_HUB_UNLOCK(hub, level);
 
     /* free current node */
-    MCN_FREE(cur_node);
+    MCN_FREE_ALIGN(cur_node);
+
+    mcn_release(hub);
 
     return RT_EOK;
 }
 
+/* Events collected during a batch publish, each is sent once afterwards */
+struct mcn_wake_set {
+    MCN_EVENT_HANDLE event[MCN_BATCH_WAKE_NUM];
+    rt_uint32_t num;
+};
+
 /**
- * @brief Publish uMCN topic
+ * @brief Send out event to wakeup waiting task
  *
- * @param hub uMCN hub, which can be obtained by MCN_HUB() macro
- * @param data Data of topic to publish
- * @return rt_err_t RT_EOK indicates success
+ * @param event Event handle
+ * @param wake Wake set to defer the event to, RT_NULL to send at once
  */
-rt_err_t mcn_publish(McnHub_t hub, const void* data)
+static void mcn_wakeup(MCN_EVENT_HANDLE event, struct mcn_wake_set* wake)
 {
-    MCN_ASSERT(hub != RT_NULL);
-    MCN_ASSERT(data != RT_NULL);
+    if (wake != RT_NULL) {
+        rt_uint32_t i;
 
-    if (hub->pdata == RT_NULL) {
-        /* hub is not advertised yet */
-        return -RT_ERROR;
+        for (i = 0; i < wake->num; i++) {
+            if (wake->event[i] == event) {
+                /* task is already to be woken */
+                return;
+            }
+        }
+        if (wake->num < MCN_BATCH_WAKE_NUM) {
+            wake->event[wake->num++] = event;
+            return;
+        }
     }
 
-    if (hub->suspend) {
-        return -RT_ERROR;
-    }
+    /* stimulate as mutex */
+    if (event->value == 0)
+        MCN_SEND_EVENT(event);
+}
 
-    /* update freq estimator window */
-    hub->freq_est_window[hub->window_index]++;
+/**
+ * @brief Update hub data and notify subscribe nodes
+ * @note Must be called with hub locked
+ *
+ * @param hub uMCN hub
+ * @param offset Offset of updated data in topic
+ * @param len Length of updated data
+ * @param data Updated data, RT_NULL if it's already in place
+ * @param wake Wake set to collect events, RT_NULL to send them at once
+ */
+static void mcn_commit(McnHub_t hub, rt_uint32_t offset, rt_uint32_t len, const void* data,
+    struct mcn_wake_set* wake)
+{
+#ifdef UMCN_USING_PARTIAL
+    rt_uint32_t dirty = mcn_dirty_chunks(hub, offset, len);
+#endif
 
-    MCN_ENTER_CRITICAL;
     /* copy data to hub */
-    rt_memcpy(hub->pdata, data, hub->obj_size);
+    if (data != RT_NULL) {
+        mcn_memcpy((rt_uint8_t*)hub->pdata + offset, data, len);
+    }
+#ifdef MCN_HUB_TIMESTAMP
+    hub->timestamp = MCN_TIMESTAMP_US();
+#endif
+#ifndef UMCN_USING_COMPACT
+    mcn_freq_count(hub);
+#endif
+#ifdef UMCN_USING_HISTORY
+#ifdef MCN_HUB_TIMESTAMP
+    mcn_history_push(hub, hub->timestamp);
+#else
+    mcn_history_push(hub, MCN_TIMESTAMP_US());
+#endif
+#endif
+#ifdef UMCN_USING_GRAPH
+    mcn_graph_publish(hub);
+#endif
+#ifdef UMCN_USING_PERSIST
+    if (hub->persist) {
+        /* a live sample replaces the restored one */
+        hub->stale = 0;
+        hub->persist_dirty = 1;
+    }
+#endif
+#ifdef UMCN_USING_RECORDER
+    if (hub->rec_id) {
+        mcn_recorder_record(hub);
+    }
+#endif
     /* traverse each node */
     McnNode_t node = hub->link_head;
 
     while (node != RT_NULL) {
+#ifdef UMCN_USING_GRAPH
+        if (MCN_NODE_RENEWAL(node) && node->pub_cb == RT_NULL) {
+            /* last sample is not read yet */
+            node->dropped++;
+        }
+        node->delivered++;
+#endif
         /* update each node's renewal flag */
-        node->renewal = 1;
+        MCN_NODE_SET_RENEWAL(node);
+#ifdef UMCN_USING_PARTIAL
+        node->dirty |= dirty;
+#endif
+
+#ifdef UMCN_USING_GROUP
+        if (node->group != RT_NULL) {
+            mcn_group_update(hub, node);
+        }
+#endif
 
         /* send out event to wakeup waiting task */
-        if (node->event) {
-            /* stimulate as mutex */
-            if (node->event->value == 0)
-                MCN_SEND_EVENT(node->event);
+        MCN_EVENT_HANDLE event = MCN_NODE_EVENT(node);
+        if (event) {
+            /* traced by publisher, node doesn't know its hub */
+            MCN_TRACE(MCN_TRACE_WAKEUP, hub);
+            mcn_wakeup(event, wake);
         }
 
         node = node->next;
     }
 
-    hub->published = 1;
-    MCN_EXIT_CRITICAL;
+    if (!hub->published) {
+        /* avoid dirtying the read-mostly cache line on every publish */
+        hub->published = 1;
+    }
+}
 
-    /* invoke callback func */
-    node = hub->link_head;
+/**
+ * @brief Invoke publish callback of each subscribe node
+ *
+ * @param hub uMCN hub
+ * @param data Published topic data passed to callbacks
+ */
+static void mcn_invoke_callback(McnHub_t hub, void* data)
+{
+    McnNode_t node = hub->link_head;
+
+#ifdef UMCN_USING_RECORDER
+    if (hub->rec_id) {
+        mcn_recorder_check(hub, data);
+    }
+#endif
 
     while (node != RT_NULL) {
+        /* node may be unsubscribed inside its callback */
+        McnNode_t next = node->next;
+#ifdef UMCN_USING_GROUP
+        if (node->group != RT_NULL) {
+            /* group node has no publish callback of its own */
+            if (node->group->pending) {
+                mcn_group_invoke(node->group);
+            }
+            node = next;
+            continue;
+        }
+#endif
+
         if (node->pub_cb != RT_NULL) {
-            node->pub_cb(hub->pdata);
+            MCN_TRACE(MCN_TRACE_CALLBACK_BEGIN, hub);
+#ifdef UMCN_USING_GRAPH
+            rt_uint64_t start = MCN_TIMESTAMP_US();
+
+            hub->cb_node = node;
+            node->pub_cb(data);
+            if (hub->cb_node == node) {
+                node->cb_time += MCN_TIMESTAMP_US() - start;
+            }
+#else
+            node->pub_cb(data);
+#endif
+            MCN_TRACE(MCN_TRACE_CALLBACK_END, hub);
         }
+        node = next;
+    }
+}
 
-        node = node->next;
+/**
+ * @brief Publish uMCN topic
+ *
+ * @param hub uMCN hub, which can be obtained by MCN_HUB() macro
+ * @param data Data of topic to publish
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_publish(McnHub_t hub, const void* data)
+{
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(data != RT_NULL);
+
+#ifdef UMCN_USING_VARSIZE
+    if (hub->varsize) {
+        /* publish with the maximal size */
+        return mcn_publish_var(hub, data, hub->obj_size);
+    }
+#endif
+
+    if (hub->pdata == RT_NULL) {
+        /* hub is not advertised yet */
+        return -RT_ERROR;
+    }
+
+    if (hub->suspend || hub->destroyed) {
+        return -RT_ERROR;
+    }
+
+    MCN_TRACE(MCN_TRACE_PUBLISH_BEGIN, hub);
+
+    MCN_HUB_LOCK(hub, level);
+    mcn_commit(hub, 0, hub->obj_size, data, RT_NULL);
+    MCN_HUB_UNLOCK(hub, level);
+
+    /* invoke callback func */
+    mcn_invoke_callback(hub, hub->pdata);
+
+    MCN_TRACE(MCN_TRACE_PUBLISH_END, hub);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Publish several uMCN topics at once
+ * @note All topics are locked (in ascending address order) while being updated,
+ * so subscribers never see part of the batch. A task waiting for several of
+ * the topics with the same event is woken only once
+ *
+ * @param items Topics and their data, each topic can appear only once
+ * @param num Number of items, at most MCN_BATCH_MAX_NUM
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_publish_batch(const McnBatchItem* items, rt_uint32_t num)
+{
+    rt_uint8_t order[MCN_BATCH_MAX_NUM];
+    struct mcn_wake_set wake;
+    /* interrupt status saved by each topic lock, restored in reverse order */
+    rt_base_t level[MCN_BATCH_MAX_NUM];
+    rt_uint32_t i, j;
+
+    MCN_ASSERT(items != RT_NULL);
+
+    if (num == 0 || num > MCN_BATCH_MAX_NUM) {
+        return -RT_EINVAL;
+    }
+
+    for (i = 0; i < num; i++) {
+        McnHub_t hub = items[i].hub;
+
+        MCN_ASSERT(hub != RT_NULL);
+        MCN_ASSERT(items[i].data != RT_NULL);
+
+        if (MCN_HUB_VARSIZE(hub)) {
+            return -RT_EINVAL;
+        }
+
+        if (hub->pdata == RT_NULL) {
+            /* hub is not advertised yet */
+            return -RT_ERROR;
+        }
+
+        if (hub->suspend || hub->destroyed) {
+            return -RT_ERROR;
+        }
+
+        /* sort by hub address, the same order is used by all multi-topic locking */
+        for (j = i; j > 0 && items[order[j - 1]].hub >= hub; j--) {
+            if (items[order[j - 1]].hub == hub) {
+                /* a topic can't be locked twice */
+                return -RT_EINVAL;
+            }
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    for (i = 0; i < num; i++) {
+        MCN_TRACE(MCN_TRACE_PUBLISH_BEGIN, items[i].hub);
+    }
+
+    wake.num = 0;
+    for (i = 0; i < num; i++) {
+        MCN_HUB_LOCK(items[order[i]].hub, level[i]);
+    }
+    for (i = 0; i < num; i++) {
+        McnHub_t hub = items[i].hub;
+
+        mcn_commit(hub, 0, hub->obj_size, items[i].data, &wake);
+    }
+    for (i = num; i > 0; i--) {
+        MCN_HUB_UNLOCK(items[order[i - 1]].hub, level[i - 1]);
+    }
+
+    for (i = 0; i < wake.num; i++) {
+        mcn_wakeup(wake.event[i], RT_NULL);
+    }
+
+    for (i = 0; i < num; i++) {
+        /* invoke callback func */
+        mcn_invoke_callback(items[i].hub, items[i].hub->pdata);
+    }
+
+    /* publish slices are nested, the last opened one is closed first */
+    for (i = num; i > 0; i--) {
+        MCN_TRACE(MCN_TRACE_PUBLISH_END, items[i - 1].hub);
+    }
+
+    return RT_EOK;
+}
+
+#ifdef UMCN_USING_VARSIZE
+/**
+ * @brief Publish variable size uMCN topic
+ * @note Data is copied into a new slab buffer before taking the lock, the
+ * buffer then replaces the previous one. Callbacks receive the published
+ * buffer even if the topic is published again meanwhile
+ *
+ * @param hub uMCN hub defined by MCN_DEFINE_VAR() or created by mcn_create_var()
+ * @param data Data to publish, can be RT_NULL if len is 0
+ * @param len Length of data, at most the maximal topic size
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_publish_var(McnHub_t hub, const void* data, rt_uint32_t len)
+{
+    struct mcn_buf* buf;
+    struct mcn_buf* old;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(data != RT_NULL || len == 0);
+
+    if (!hub->varsize || len > hub->obj_size) {
+        return -RT_EINVAL;
+    }
+
+    if (hub->pdata == RT_NULL) {
+        /* hub is not advertised yet */
+        return -RT_ERROR;
+    }
+
+    if (hub->suspend || hub->destroyed) {
+        return -RT_ERROR;
+    }
+
+    buf = mcn_buf_alloc(len);
+    if (buf == RT_NULL) {
+        return -RT_ENOMEM;
+    }
+    mcn_memcpy(buf->data, data, len);
+
+    MCN_TRACE(MCN_TRACE_PUBLISH_BEGIN, hub);
+
+    MCN_HUB_LOCK(hub, level);
+    old = MCN_BUF_OF(hub->pdata);
+    hub->pdata = buf->data;
+    mcn_commit(hub, 0, len, RT_NULL, RT_NULL);
+    /* hold the buffer for callbacks */
+    mcn_buf_get(buf);
+    MCN_HUB_UNLOCK(hub, level);
+
+    mcn_buf_put(old);
+
+    /* invoke callback func */
+    mcn_invoke_callback(hub, buf->data);
+    mcn_buf_put(buf);
+
+    MCN_TRACE(MCN_TRACE_PUBLISH_END, hub);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Copy variable size uMCN topic data from hub
+ * @note Only the published length is copied. This function will clear the renewal flag
+ *
+ * @param hub uMCN hub
+ * @param node_t uMCN node
+ * @param buffer Buffer to received the data
+ * @param size Size of buffer
+ * @return rt_int32_t Length of copied data, or negative error code
+ */
+rt_int32_t mcn_copy_var(McnHub_t hub, McnNode_t node_t, void* buffer, rt_uint32_t size)
+{
+    rt_uint32_t len;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(node_t != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    if (hub->pdata == RT_NULL || !hub->published) {
+        /* copy from non-advertised or non-published hub */
+        return -RT_ERROR;
+    }
+
+    MCN_HUB_LOCK(hub, level);
+    len = MCN_HUB_DATA_LEN(hub);
+    if (len > size) {
+        MCN_HUB_UNLOCK(hub, level);
+        return -RT_EFULL;
+    }
+    mcn_memcpy(buffer, hub->pdata, len);
+    MCN_NODE_CLEAR_RENEWAL(node_t);
+#ifdef UMCN_USING_PARTIAL
+    node_t->dirty = 0;
+#endif
+    MCN_HUB_UNLOCK(hub, level);
+
+    MCN_TRACE(MCN_TRACE_COPY, hub);
+
+    return (rt_int32_t)len;
+}
+
+/**
+ * @brief Borrow the data of variable size uMCN topic without copy
+ * @note The data stays valid and unchanged until mcn_return() is called, even
+ * if the topic is published again. This function will clear the renewal flag
+ *
+ * @param hub uMCN hub
+ * @param node_t uMCN node
+ * @param len Length of data
+ * @return const void* Topic data, RT_NULL if fail
+ */
+const void* mcn_borrow(McnHub_t hub, McnNode_t node_t, rt_uint32_t* len)
+{
+    struct mcn_buf* buf;
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(node_t != RT_NULL);
+    MCN_ASSERT(len != RT_NULL);
+
+    if (!hub->varsize || hub->pdata == RT_NULL || !hub->published) {
+        return RT_NULL;
+    }
+
+    MCN_HUB_LOCK(hub, level);
+    buf = MCN_BUF_OF(hub->pdata);
+    mcn_buf_get(buf);
+    MCN_NODE_CLEAR_RENEWAL(node_t);
+#ifdef UMCN_USING_PARTIAL
+    node_t->dirty = 0;
+#endif
+    MCN_HUB_UNLOCK(hub, level);
+
+    MCN_TRACE(MCN_TRACE_COPY, hub);
+
+    *len = buf->len;
+
+    return buf->data;
+}
+
+/**
+ * @brief Return the data borrowed by mcn_borrow()
+ *
+ * @param data Borrowed data
+ */
+void mcn_return(const void* data)
+{
+    MCN_ASSERT(data != RT_NULL);
+
+    mcn_buf_put(MCN_BUF_OF(data));
+}
+#endif
+
+#ifdef UMCN_USING_PERSIST
+/**
+ * @brief Restore topic data from snapshot
+ * @note Subscribers see it as a published sample, but the topic is marked stale
+ * until it's really published. Nothing is done if it's already published
+ *
+ * @param hub uMCN hub
+ * @param data Restored data
+ * @param len Length of data
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_restore(McnHub_t hub, const void* data, rt_uint32_t len)
+{
+    void* pdata;
+    rt_base_t level;
+#ifdef UMCN_USING_VARSIZE
+    struct mcn_buf* buf = RT_NULL;
+    struct mcn_buf* old = RT_NULL;
+
+    if (hub->varsize) {
+        buf = mcn_buf_alloc(len);
+        if (buf == RT_NULL) {
+            return -RT_ENOMEM;
+        }
+        mcn_memcpy(buf->data, data, len);
+    }
+#endif
+
+    MCN_HUB_LOCK(hub, level);
+    if (hub->published) {
+        MCN_HUB_UNLOCK(hub, level);
+#ifdef UMCN_USING_VARSIZE
+        if (buf != RT_NULL) {
+            mcn_buf_put(buf);
+        }
+#endif
+        return -RT_EBUSY;
+    }
+#ifdef UMCN_USING_VARSIZE
+    if (buf != RT_NULL) {
+        old = MCN_BUF_OF(hub->pdata);
+        hub->pdata = buf->data;
+        data = RT_NULL;
+        /* hold the buffer for callbacks */
+        mcn_buf_get(buf);
+    }
+#endif
+    mcn_commit(hub, 0, len, data, RT_NULL);
+    hub->stale = 1;
+    hub->persist_dirty = 0;
+    pdata = hub->pdata;
+    MCN_HUB_UNLOCK(hub, level);
+
+    mcn_invoke_callback(hub, pdata);
+
+#ifdef UMCN_USING_VARSIZE
+    if (buf != RT_NULL) {
+        mcn_buf_put(old);
+        mcn_buf_put(buf);
+    }
+#endif
+
+    return RT_EOK;
+}
+#endif
+
+#ifdef UMCN_USING_PARTIAL
+/**
+ * @brief Publish part of uMCN topic
+ * @note Only the given range of topic data is updated, the rest keeps the
+ * previously published value. Subscribers can query the changed ranges by
+ * mcn_dirty_range()
+ *
+ * @param hub uMCN hub
+ * @param offset Offset of data in topic, e.g, offsetof(topic_t, field)
+ * @param len Length of data
+ * @param data Data to publish
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_publish_partial(McnHub_t hub, rt_uint32_t offset, rt_uint32_t len, const void* data)
+{
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(data != RT_NULL);
+
+    if (len == 0 || offset > hub->obj_size || len > hub->obj_size - offset || MCN_HUB_VARSIZE(hub)) {
+        return -RT_EINVAL;
+    }
+
+    if (hub->pdata == RT_NULL) {
+        /* hub is not advertised yet */
+        return -RT_ERROR;
+    }
+
+    if (hub->suspend || hub->destroyed) {
+        return -RT_ERROR;
     }
 
+    MCN_TRACE(MCN_TRACE_PUBLISH_BEGIN, hub);
+
+    MCN_HUB_LOCK(hub, level);
+    mcn_commit(hub, offset, len, data, RT_NULL);
+    MCN_HUB_UNLOCK(hub, level);
+
+    /* invoke callback func */
+    mcn_invoke_callback(hub, hub->pdata);
+
+    MCN_TRACE(MCN_TRACE_PUBLISH_END, hub);
+
     return RT_EOK;
 }
 
+/**
+ * @brief Copy part of uMCN topic data from hub
+ * @note Dirty chunks fully covered by the range are cleared. The renewal
+ * flag is cleared once no dirty chunk is left
+ *
+ * @param hub uMCN hub
+ * @param node_t uMCN node
+ * @param offset Offset of data in topic
+ * @param len Length of data
+ * @param buffer buffer to received the data
+ * @return rt_err_t RT_EOK indicates success
+ */
+rt_err_t mcn_copy_partial(McnHub_t hub, McnNode_t node_t, rt_uint32_t offset, rt_uint32_t len, void* buffer)
+{
+    rt_base_t level;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(node_t != RT_NULL);
+    MCN_ASSERT(buffer != RT_NULL);
+
+    if (len == 0 || offset > hub->obj_size || len > hub->obj_size - offset || MCN_HUB_VARSIZE(hub)) {
+        return -RT_EINVAL;
+    }
+
+    if (hub->pdata == RT_NULL) {
+        /* copy from non-advertised hub */
+        return -RT_ERROR;
+    }
+
+    if (!hub->published) {
+        /* copy before published */
+        return -RT_ERROR;
+    }
+
+    MCN_HUB_LOCK(hub, level);
+    mcn_memcpy(buffer, (rt_uint8_t*)hub->pdata + offset, len);
+    node_t->dirty &= ~mcn_covered_chunks(hub, offset, len);
+    if (node_t->dirty == 0) {
+        MCN_NODE_CLEAR_RENEWAL(node_t);
+    }
+    MCN_HUB_UNLOCK(hub, level);
+
+    MCN_TRACE(MCN_TRACE_COPY, hub);
+
+    return RT_EOK;
+}
+
+/**
+ * @brief Check if a range of topic data has changed since last copy
+ *
+ * @param hub uMCN hub
+ * @param node_t uMCN node
+ * @param offset Offset of data in topic
+ * @param len Length of data
+ * @return RT_TRUE The range (or a chunk it shares) has been updated
+ * @return RT_FALSE The range is not updated
+ */
+rt_bool_t mcn_is_dirty(McnHub_t hub, McnNode_t node_t, rt_uint32_t offset, rt_uint32_t len)
+{
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(node_t != RT_NULL);
+
+    if (len == 0 || offset >= hub->obj_size) {
+        return RT_FALSE;
+    }
+
+    if (len > hub->obj_size - offset) {
+        len = hub->obj_size - offset;
+    }
+
+    return (node_t->dirty & mcn_dirty_chunks(hub, offset, len)) ? RT_TRUE : RT_FALSE;
+}
+
+/**
+ * @brief Find the next changed range of topic data
+ * @note The range is tracked in chunk granularity, so it may be a little
+ * larger than the actually published range
+ *
+ * @param hub uMCN hub
+ * @param node_t uMCN node
+ * @param offset [in] Offset to start searching, [out] offset of changed range
+ * @param len [out] Length of changed range
+ * @return RT_TRUE A changed range is found
+ * @return RT_FALSE No more changed range
+ */
+rt_bool_t mcn_dirty_range(McnHub_t hub, McnNode_t node_t, rt_uint32_t* offset, rt_uint32_t* len)
+{
+    rt_uint32_t chunk_size;
+    rt_uint32_t dirty;
+    rt_uint32_t start, end;
+
+    MCN_ASSERT(hub != RT_NULL);
+    MCN_ASSERT(node_t != RT_NULL);
+    MCN_ASSERT(offset != RT_NULL && len != RT_NULL);
+
+    if (*offset >= hub->obj_size) {
+        return RT_FALSE;
+    }
+
+    chunk_size = MCN_DIRTY_CHUNK_SIZE(hub);
+    dirty = node_t->dirty;
+
+    for (start = *offset / chunk_size; start < MCN_DIRTY_CHUNK_NUM; start++) {
+        if (dirty & (1UL << start)) {
+            break;
+        }
+    }
+    if (start >= MCN_DIRTY_CHUNK_NUM || start * chunk_size >= hub->obj_size) {
+        return RT_FALSE;
+    }
+
+    for (end = start; end < MCN_DIRTY_CHUNK_NUM; end++) {
+        if (!(dirty & (1UL << end))) {
+            break;
+        }
+    }
+
+    start *= chunk_size;
+    if (start < *offset) {
+        start = *offset;
+    }
+    end *= chunk_size;
+    if (end > hub->obj_size) {
+        end = hub->obj_size;
+    }
+
+    *offset = start;
+    *len = end - start;
+
+    return RT_TRUE;
+}
+#endif
+
+/**
+ * @brief Get memory used by uMCN
+ * @note Sizes are the bytes requested from allocator, allocator overhead is
+ * not included. Static topics are counted as well
+ *
+ * @param usage Memory usage
+ */
+void mcn_mem_usage(McnMemUsage* usage)
+{
+    rt_base_t level;
+    McnList_t ite = mcn_get_list();
+
+    MCN_ASSERT(usage != RT_NULL);
+
+    memset(usage, 0, sizeof(McnMemUsage));
+
+    for (McnHub_t hub = mcn_iterate(&ite); hub != RT_NULL; hub = mcn_iterate(&ite)) {
+        rt_uint32_t hub_size = sizeof(McnHub);
+
+        if (hub->ref) {
+            /* runtime topic, name is stored after the hub */
+            hub_size = MCN_ALLOC_SIZE(sizeof(McnHub) + strlen(hub->obj_name) + 1);
+        }
+        usage->topic_num++;
+        usage->node_num += hub->link_num;
+        usage->hub += hub_size - sizeof(McnList);
+        usage->list += sizeof(McnList);
+        if (!MCN_HUB_VARSIZE(hub)) {
+            /* data of variable size topic is counted in slab */
+            usage->payload += MCN_ALLOC_SIZE(hub->obj_size);
+        }
+        usage->node += hub->link_num * MCN_ALLOC_SIZE(sizeof(McnNode));
+#ifdef UMCN_USING_HISTORY
+        usage->history += mcn_history_size(hub);
+#endif
+    }
+
+    MCN_LOCK(level);
+    usage->registry = __mcn_table_size * sizeof(McnList_t);
+    MCN_UNLOCK(level);
+
+#ifdef UMCN_USING_VARSIZE
+    usage->slab = mcn_slab_size();
+#endif
+
+    usage->total = usage->hub + usage->list + usage->payload + usage->node + usage->registry + usage->history
+        + usage->slab;
+}
+
 /**
  * @brief Initialize uMCN module
  * 
@@ -461,16 +1751,19 @@ rt_err_t mcn_publish(McnHub_t hub, const void* data)
  */
 int mcn_init(void)
 {
-    rt_timer_init(&timer_mcn_freq_est, "mcn_freq_est",
-        mcn_freq_est_entry,
-        RT_NULL,
-        RT_TICK_PER_SECOND,
-        RT_TIMER_FLAG_PERIODIC | RT_TIMER_FLAG_SOFT_TIMER);
+#ifdef UMCN_USING_WATCH
+    if (mcn_watch_init() != RT_EOK) {
+        LOG_E("watch init error!");
+        return -RT_ERROR;
+    }
+#endif
 
-    if (rt_timer_start(&timer_mcn_freq_est) != RT_EOK) {
-        LOG_E("timer start error!");
+#ifdef UMCN_USING_PATTERN
+    if (mcn_pattern_init() != RT_EOK) {
+        LOG_E("pattern init error!");
         return -RT_ERROR;
     }
+#endif
 
     return RT_EOK;
 }